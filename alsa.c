@@ -5,12 +5,12 @@
 #include <xcb/xcb.h>
 
 #include "bspwmbar.h"
+#include "snapshot.h"
 
 enum {
 	ALSACTL_GETINFO = 1,
 	ALSACTL_TOGGLE_MUTE,
-	ALSACTL_VOLUME_UP,
-	ALSACTL_VOLUME_DOWN,
+	ALSACTL_VOLUME_STEP,
 };
 
 typedef struct {
@@ -21,19 +21,25 @@ typedef struct {
 	int  has_switch;
 } alsa_info_t;
 
+/* NULL while the device is down */
 static snd_ctl_t *ctl;
 static snd_mixer_t *amixer;
 static int initialized = 0;
 static alsa_info_t info = { 0 };
+/* copy of info read by the render thread */
+static snapshot_t shown = NULL;
 static poll_fd_t pfd = { 0 };
 
 /* functions */
 static void get_info(snd_mixer_elem_t *);
 static void toggle_mute(snd_mixer_elem_t *);
 static void set_volume(snd_mixer_elem_t *, long);
-static void alsa_control(uint8_t);
+static void alsa_control(uint8_t, int);
+static void alsa_publish(void);
+static void alsa_scroll(module_option_t *, int);
 static int alsa_connect(void);
 static int alsa_disconnect(void);
+static int alsa_release(void);
 static poll_result_t alsa_update(int);
 
 void
@@ -70,12 +76,19 @@ set_volume(snd_mixer_elem_t *elem, long volume)
 	snd_mixer_selem_set_playback_volume_all(elem, volume);
 }
 
+/**
+ * alsa_control() - control the Master element.
+ * @ctlno: ALSACTL_*
+ * @steps: steps of 5% for ALSACTL_VOLUME_STEP.
+ */
 void
-alsa_control(uint8_t ctlno)
+alsa_control(uint8_t ctlno, int steps)
 {
 	snd_mixer_elem_t *elem = NULL;
 	snd_mixer_selem_id_t *sid = NULL;
 
+	if (!amixer)
+		return;
 	snd_mixer_selem_id_alloca(&sid);
 	snd_mixer_selem_id_set_index(sid, 0);
 	snd_mixer_selem_id_set_name(sid, "Master");
@@ -91,71 +104,151 @@ alsa_control(uint8_t ctlno)
 	case ALSACTL_TOGGLE_MUTE:
 		toggle_mute(elem);
 		break;
-	case ALSACTL_VOLUME_UP:
-		set_volume(elem, info.volume + info.oneper * 5);
-		break;
-	case ALSACTL_VOLUME_DOWN:
-		set_volume(elem, info.volume - info.oneper * 5);
+	case ALSACTL_VOLUME_STEP:
+		set_volume(elem, info.volume + info.oneper * 5 * steps);
 		break;
 	}
 }
 
+/**
+ * alsa_publish() - publish the current info for volume().
+ */
+void
+alsa_publish(void)
+{
+	alsa_info_t *copy = malloc(sizeof(alsa_info_t));
+
+	*copy = info;
+	snapshot_publish(&shown, copy, free);
+}
+
+/**
+ * alsa_scroll() - set the volume moved by the scroll wheel.
+ * @opts: module options.
+ * @steps: net steps of the scroll wheel.
+ *
+ * The volume set is published in place of the one predicted by volume_ev(),
+ * since the control device reports nothing if it has not been changed.
+ */
+void
+alsa_scroll(module_option_t *opts, int steps)
+{
+	(void)opts;
+	/* the device is down */
+	if (!amixer)
+		return;
+	alsa_control(ALSACTL_VOLUME_STEP, steps);
+	alsa_control(ALSACTL_GETINFO, 0);
+	alsa_publish();
+}
+
+/**
+ * alsa_connect() - open the default control device and mixer.
+ *
+ * It is called again by the poll supervisor when the device has gone, and
+ * the range of the volume is read again from the new device.
+ *
+ * Return: poll descriptor of the control device or -1.
+ */
 int
 alsa_connect(void)
 {
-	if (snd_ctl_open(&ctl, "default", SND_CTL_READONLY | SND_CTL_NONBLOCK))
-		return -1;
+	struct pollfd pfds;
 
-	if (snd_ctl_subscribe_events(ctl, 1)) {
-		snd_ctl_close(ctl);
+	if (snd_ctl_open(&ctl, "default", SND_CTL_READONLY | SND_CTL_NONBLOCK)) {
+		ctl = NULL;
 		return -1;
 	}
 
 	/* mixer initialization */
-	if (snd_mixer_open(&amixer, 0)) {
-		snd_ctl_close(ctl);
+	if (snd_ctl_subscribe_events(ctl, 1) || snd_mixer_open(&amixer, 0)) {
+		amixer = NULL;
+		alsa_disconnect();
 		return -1;
 	}
-	snd_mixer_attach(amixer, "default");
-	snd_mixer_selem_register(amixer, NULL, NULL);
-	snd_mixer_load(amixer);
-
-	/* get poll fd */
-	struct pollfd pfds;
-	if (!snd_ctl_poll_descriptors(ctl, &pfds, 1)) {
-		snd_ctl_close(ctl);
+	if (snd_mixer_attach(amixer, "default") || snd_mixer_selem_register(amixer, NULL, NULL) ||
+	    snd_mixer_load(amixer) || snd_ctl_poll_descriptors(ctl, &pfds, 1) != 1) {
+		alsa_disconnect();
 		return -1;
 	}
+
+	initialized = 0;
+	alsa_control(ALSACTL_GETINFO, 0);
+	alsa_publish();
 	return pfds.fd;
 }
 
+/**
+ * alsa_update() - PollUpdateHandler for the control device.
+ * @fd: poll descriptor of ctl.
+ *
+ * All pending events are drained and the volume is read once, so a burst
+ * of changes results in one update.
+ *
+ * Return: poll_result_t
+ */
 poll_result_t
 alsa_update(int fd)
 {
 	(void)fd;
 	snd_ctl_event_t *event;
+	alsa_info_t prev = info;
+	bool elem = false, value = false;
+	int ret;
 
 	snd_ctl_event_alloca(&event);
-	if (snd_ctl_read(ctl, event) < 0)
+	while ((ret = snd_ctl_read(ctl, event)) > 0) {
+		pfd.nevent++;
+		if (snd_ctl_event_get_type(event) != SND_CTL_EVENT_ELEM)
+			continue;
+		elem = true;
+		if (snd_ctl_event_elem_get_mask(event) & SND_CTL_EVENT_MASK_VALUE)
+			value = true;
+	}
+	if (ret < 0 && ret != -EAGAIN)
 		return PR_REINIT;
-	if (snd_ctl_event_get_type(event) != SND_CTL_EVENT_ELEM)
+	if (elem)
+		snd_mixer_handle_events(amixer);
+	if (!value)
 		return PR_NOOP;
 
-	snd_mixer_handle_events(amixer);
-
-	unsigned int mask = snd_ctl_event_elem_get_mask(event);
-	if (!(mask & SND_CTL_EVENT_MASK_VALUE))
+	alsa_control(ALSACTL_GETINFO, 0);
+	if (info.volume == prev.volume && info.unmuted == prev.unmuted)
 		return PR_NOOP;
-
-	alsa_control(ALSACTL_GETINFO);
+	alsa_publish();
 
 	return PR_UPDATE;
 }
 
+/**
+ * alsa_disconnect() - close the control device and mixer.
+ *
+ * The volume shown last is kept while the device is down.
+ *
+ * Return: 0
+ */
 int
 alsa_disconnect(void)
 {
-	return snd_ctl_close(ctl);
+	if (amixer)
+		snd_mixer_close(amixer);
+	if (ctl)
+		snd_ctl_close(ctl);
+	amixer = NULL;
+	ctl = NULL;
+	return 0;
+}
+
+/**
+ * alsa_release() - release the volume shown last.
+ *
+ * Return: 0
+ */
+int
+alsa_release(void)
+{
+	snapshot_publish(&shown, NULL, free);
+	return 0;
 }
 
 void
@@ -164,50 +257,69 @@ alsa_init(void)
 	pfd.fd = alsa_connect();
 	pfd.init = alsa_connect;
 	pfd.deinit = alsa_disconnect;
+	pfd.release = alsa_release;
 	pfd.handler = alsa_update;
+	pfd.name = "alsa";
 	poll_add(&pfd);
 }
 
 void
 volume(draw_context_t *dc, module_option_t *opts)
 {
-	if (!pfd.fd)
+	alsa_info_t *vol;
+
+	if (!pfd.handler)
 		alsa_init();
+	if (!(vol = snapshot_get(&shown)))
+		return;
 
 	if (!opts->vol.prefix)
 		opts->vol.prefix = "";
 	if (!opts->vol.suffix)
 		opts->vol.suffix = "";
 
-	if (!info.volume)
-		alsa_control(ALSACTL_GETINFO);
-
-	const char *mark = (info.unmuted) ? opts->vol.unmuted : opts->vol.muted;
-	sprintf(buf, "%s%s %.0lf%s", opts->vol.prefix,  mark,
-	                             (double)info.volume / info.max * 100,
-	                             opts->vol.suffix);
+	const char *mark = (vol->unmuted) ? opts->vol.unmuted : opts->vol.muted;
+	draw_text_run(dc, &opts->vol.prefix_run, opts->vol.prefix);
+	sprintf(buf, "%s ", mark);
 	draw_text(dc, buf);
+	sprintf(buf, "%.0lf", (double)vol->volume / vol->max * 100);
+	draw_numeric(dc, buf);
+	draw_text_run(dc, &opts->vol.suffix_run, opts->vol.suffix);
 }
 
 void
-volume_ev(xcb_generic_event_t *ev, module_option_t *unused)
+volume_ev(xcb_generic_event_t *ev, module_option_t *opts)
 {
 	xcb_button_press_event_t *button;
-	(void)unused;
+	alsa_info_t *predicted;
+	int steps;
+
+	/* the device is down */
+	if (!amixer)
+		return;
+
 	switch (ev->response_type & ~0x80) {
 	case XCB_BUTTON_PRESS:
 		button = (xcb_button_press_event_t *)ev;
 		switch (button->detail) {
 		case XCB_BUTTON_INDEX_1:
-			alsa_control(ALSACTL_TOGGLE_MUTE);
-			break;
+			alsa_control(ALSACTL_TOGGLE_MUTE, 0);
+			alsa_publish();
+			return;
 		case XCB_BUTTON_INDEX_4:
-			alsa_control(ALSACTL_VOLUME_UP);
+			steps = module_scroll(opts, 1, alsa_scroll);
 			break;
 		case XCB_BUTTON_INDEX_5:
-			alsa_control(ALSACTL_VOLUME_DOWN);
+			steps = module_scroll(opts, -1, alsa_scroll);
 			break;
+		default:
+			return;
 		}
+		/* the mixer is written once the wheel stops */
+		predicted = malloc(sizeof(alsa_info_t));
+		*predicted = info;
+		predicted->volume = SMALLER(BIGGER(info.volume + info.oneper * 5 * steps, info.min), info.max);
+		snapshot_publish(&shown, predicted, free);
 		break;
 	}
 }
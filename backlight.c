@@ -14,6 +14,7 @@
 #include <xcb/randr.h>
 
 #include "bspwmbar.h"
+#include "collect.h"
 #include "util.h"
 
 typedef struct {
@@ -22,22 +23,117 @@ typedef struct {
 	int32_t cur;
 } backlight_t;
 
-static bool backlight_load(backlight_t *, const char *dev);
+typedef struct {
+	bool loaded;
+	uint32_t blightness; /* percentage */
+	backlight_t backlight;
+} backlight_state_t;
+
+static bool backlight_load(backlight_t *, module_option_t *);
+static bool backlight_update(module_option_t *, void *);
+static uint32_t backlight_percent(const backlight_t *);
+static int32_t backlight_step(const backlight_t *, int);
+static void backlight_apply(module_option_t *, int);
 static void backlight_set(int32_t);
 
+static const module_sampler_t sampler = {
+	.update = backlight_update,
+	.size = sizeof(backlight_state_t),
+	.interval = 1000,
+	.offload = true,
+};
+
+/**
+ * backlight_update() - sample brightness of the backlight.
+ * @opts: module options.
+ * @state: backlight_state_t
+ *
+ * Return: true if the brightness has been changed.
+ */
+bool
+backlight_update(module_option_t *opts, void *state)
+{
+	backlight_state_t *blight = state;
+	backlight_t backlight = { 0 };
+	uint32_t blightness;
+	bool loaded;
+
+	if ((loaded = backlight_load(&backlight, opts)))
+		blightness = backlight_percent(&backlight);
+	else
+		blightness = 0;
+	if (loaded == blight->loaded && blightness == blight->blightness)
+		return false;
+	blight->loaded = loaded;
+	blight->blightness = blightness;
+	blight->backlight = backlight;
+	return true;
+}
+
+/**
+ * backlight_percent() - get brightness in percentage.
+ * @backlight: backlight_t
+ *
+ * Return: percentage
+ */
+uint32_t
+backlight_percent(const backlight_t *backlight)
+{
+	return (double)(backlight->cur - backlight->min) * 100 / (double)(backlight->max - backlight->min);
+}
+
+/**
+ * backlight_step() - get brightness moved by steps of 5%.
+ * @backlight: backlight_t
+ * @steps: steps of the scroll wheel.
+ *
+ * Return: brightness
+ */
+int32_t
+backlight_step(const backlight_t *backlight, int steps)
+{
+	double step = (double)(backlight->max - backlight->min) * 0.05 + 1;
+	double cur = backlight->cur + step * steps;
+
+	return SMALLER(BIGGER(cur, backlight->min), backlight->max);
+}
+
+/**
+ * backlight_apply() - write the brightness moved by the scroll wheel.
+ * @opts: module options.
+ * @steps: net steps of the scroll wheel.
+ *
+ * The shown state keeps the last sampled brightness in backlight, only the
+ * percentage is predicted.
+ */
+void
+backlight_apply(module_option_t *opts, int steps)
+{
+	backlight_state_t *state = module_state(opts, &sampler);
+
+	if (state->loaded)
+		backlight_set(backlight_step(&state->backlight, steps));
+	module_refresh(opts);
+}
+
 void
 backlight(draw_context_t *dc, module_option_t *opts)
 {
-	backlight_t backlight = { 0 };
-	uint32_t blightness = 0;
+	backlight_state_t *state = module_state(opts, &sampler);
+	char blightness[16];
 
-	if (!backlight_load(&backlight, opts->backlight.device))
+	if (!state->loaded)
 		return;
 
-	blightness = (double)(backlight.cur - backlight.min) * 100 / (double)(backlight.max - backlight.min);
+	if (!opts->backlight.prefix)
+		opts->backlight.prefix = "";
+	if (!opts->backlight.suffix)
+		opts->backlight.suffix = "";
 
-	sprintf(buf, "%s%d%s", opts->backlight.prefix, blightness, opts->backlight.suffix);
-	draw_text(dc, buf);
+	draw_text_run(dc, &opts->backlight.prefix_run, opts->backlight.prefix);
+	sprintf(blightness, "%d", state->blightness);
+	draw_numeric(dc, blightness);
+	draw_text_run(dc, &opts->backlight.suffix_run, opts->backlight.suffix);
 }
 
 #if defined(__linux)
@@ -70,50 +166,35 @@ backlight(draw_context_t *dc, module_option_t *opts)
 static char *bdev = NULL;
 static char *mbdev = NULL;
 static int bfd = -1;
-static int mbfd = -1;
 
 bool
-backlight_load(backlight_t *backlight, const char *dev)
+backlight_load(backlight_t *backlight, module_option_t *opts)
 {
+	const char *dev = opts->backlight.device;
+
 	if (dev == NULL)
 		return false;
 
-	char bbuf[4] = { 0 };
-	char mbbuf[4] = { 0 };
+	char bbuf[16] = { 0 };
+	char mbbuf[16] = { 0 };
 
 	if (bdev == NULL) {
 		bdev = malloc(strlen(dev) + strlen("/brightness") + 1);
 		sprintf(bdev, "%s/brightness", dev);
 	}
-
-	if ((bfd = open(bdev, O_RDWR)) < 0)
-		return false;
-
-	if (read(bfd, bbuf, sizeof(bbuf)) < 0) {
-		close(bfd);
-		return false;
-	}
-
-	bbuf[3] = '\0';
-	backlight->cur = atoi(bbuf);
-	close(bfd);
-
 	if (mbdev == NULL) {
 		mbdev = malloc(strlen(dev) + strlen("/max_brightness") + 1);
 		sprintf(mbdev, "%s/max_brightness", dev);
 	}
 
-	if ((mbfd = open(mbdev, O_RDONLY)) < 0)
+	/* both files are kept open and read in one batch */
+	if (collect_read(collect_open(opts, bdev), bbuf, sizeof(bbuf)) < 0)
 		return false;
+	backlight->cur = atoi(bbuf);
 
-	if (read(mbfd, mbbuf, sizeof(mbbuf)) < 0) {
-		close(mbfd);
+	if (collect_read(collect_open(opts, mbdev), mbbuf, sizeof(mbbuf)) < 0)
 		return false;
-	}
-
-	mbbuf[3] = '\0';
 	backlight->max = atoi(mbbuf);
-	close(mbfd);
 
 	backlight->min = 0;
 
@@ -123,23 +204,23 @@ backlight_load(backlight_t *backlight, const char *dev)
 void
 backlight_set(int32_t value)
 {
-	char strval[4] = { 0 };
-	snprintf(strval, sizeof(strval), "%i", value);
+	char strval[16];
+	int len = snprintf(strval, sizeof(strval), "%i", value);
 
 	if ((bfd = open(bdev, O_RDWR)) < 0)
 		return;
 
-	(void)write(bfd, strval, sizeof(strval));
+	(void)!write(bfd, strval, len);
 	close(bfd);
 }
 
 #elif defined(__OpenBSD__) // TODO
 
 bool
-backlight_load(backlight_t *backlight, const char *dev)
+backlight_load(backlight_t *backlight, module_option_t *opts)
 {
 	(void)backlight;
-	(void)dev;
+	(void)opts;
 	return false;
 }
 
@@ -157,8 +238,10 @@ backlight_set(int32_t value)
 static int fd = -1;
 
 bool
-backlight_load(backlight_t *backlight, const char *dev)
+backlight_load(backlight_t *backlight, module_option_t *opts)
 {
+	const char *dev = opts->backlight.device;
+
 	if (dev == NULL)
 		return false;
 
@@ -202,33 +285,34 @@ backlight_set(int32_t value)
 void
 backlight_ev(xcb_generic_event_t *ev, module_option_t *opts)
 {
-	backlight_t backlight;
+	backlight_state_t *state = module_state(opts, &sampler);
+	backlight_state_t predicted = *state;
+	backlight_t moved = state->backlight;
 	xcb_button_press_event_t *button;
-	double cur, step;
+	int steps;
 
-	if (!backlight_load(&backlight, opts->backlight.device))
+	/* the last sample is used to keep I/O off the event loop */
+	if (!state->loaded)
 		return;
 
-	cur = (backlight.cur - backlight.min);
-	step = (double)(backlight.max - backlight.min) * 0.05 + 1;
-
 	switch (ev->response_type & ~0x80) {
 	case XCB_BUTTON_PRESS:
 		button = (xcb_button_press_event_t *)ev;
 		switch (button->detail) {
 		case XCB_BUTTON_INDEX_4:
-			cur = (cur / step) * step + step;
-			if (cur > backlight.max)
-				cur = backlight.max;
-			backlight_set((int32_t)cur);
+			steps = module_scroll(opts, 1, backlight_apply);
 			break;
 		case XCB_BUTTON_INDEX_5:
-			cur = (cur / step) * step - step;
-			if (cur < backlight.min)
-				cur = backlight.min;
-			backlight_set((int32_t)cur);
+			steps = module_scroll(opts, -1, backlight_apply);
 			break;
+		default:
+			module_refresh(opts);
+			return;
 		}
+		/* the brightness is written once the wheel stops */
+		moved.cur = backlight_step(&state->backlight, steps);
+		predicted.blightness = backlight_percent(&moved);
+		module_predict(opts, &predicted);
 		break;
 	}
 }
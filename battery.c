@@ -5,9 +5,9 @@
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
-#include <time.h>
 
 #include "bspwmbar.h"
+#include "collect.h"
 #include "util.h"
 
 typedef enum {
@@ -22,29 +22,56 @@ typedef struct {
 	uint32_t capacity;
 } battery_t;
 
-static bool battery_load_info(battery_t *, const char *);
+typedef struct {
+	bool loaded;
+	battery_t bat;
+} battery_state_t;
+
+static bool battery_load_info(battery_t *, module_option_t *);
+static bool battery_update(module_option_t *, void *);
 static void battery_draw(battery_t *, draw_context_t *, module_option_t *);
 
-static battery_t bat;
+static const module_sampler_t sampler = {
+	.update = battery_update,
+	.size = sizeof(battery_state_t),
+	.interval = 5000,
+	.offload = true,
+};
 
 void
 battery(draw_context_t *dc, module_option_t *opts)
 {
-	static time_t prevtime;
-	time_t curtime;
+	battery_state_t *state;
 
 	if (!opts->battery.path)
 		return;
 
-	curtime = time(NULL);
-	if (curtime - prevtime < 1) {
-		battery_draw(&bat, dc, opts);
-		return;
-	}
-	prevtime = curtime;
+	state = module_state(opts, &sampler);
+	if (state->loaded)
+		battery_draw(&state->bat, dc, opts);
+}
+
+/**
+ * battery_update() - sample the battery.
+ * @opts: module options.
+ * @state: battery_state_t
+ *
+ * Return: true if the status or capacity has been changed.
+ */
+bool
+battery_update(module_option_t *opts, void *state)
+{
+	battery_state_t *battery = state;
+	battery_t bat = battery->bat;
+	bool loaded;
 
-	if (battery_load_info(&bat, opts->battery.path))
-		battery_draw(&bat, dc, opts);
+	loaded = battery_load_info(&bat, opts);
+	if (loaded == battery->loaded && bat.status == battery->bat.status &&
+	    bat.capacity == battery->bat.capacity)
+		return false;
+	battery->loaded = loaded;
+	battery->bat = bat;
+	return true;
 }
 
 const char *
@@ -84,11 +111,12 @@ battery_prefix(battery_t *bat, module_option_t *opts)
 void
 battery_draw(battery_t *bat, draw_context_t *dc, module_option_t *opts)
 {
-	sprintf(buf, "%s%d%s",
-		battery_prefix(bat, opts),
-		bat->capacity,
-		opts->battery.suffix ? opts->battery.suffix : "");
-	draw_text(dc, buf);
+	char capacity[16];
+
+	draw_text(dc, battery_prefix(bat, opts));
+	sprintf(capacity, "%d", bat->capacity);
+	draw_numeric(dc, capacity);
+	draw_text_run(dc, &opts->battery.suffix_run, opts->battery.suffix);
 }
 
 #if defined(__linux__)
@@ -134,18 +162,22 @@ battery_parse_status(const char *str)
 }
 
 bool
-battery_load_info(battery_t *bat, const char *path)
+battery_load_info(battery_t *bat, module_option_t *opts)
 {
-	FILE *fp;
+	char data[4096], *line, *next;
 	char key[32] = { 0 };
 	char val[32] = { 0 };
 	uint32_t full = 0, now = 0;
 
-	if (!(fp = fopen(path, "r")))
+	if (collect_read(collect_open(opts, opts->battery.path), data, sizeof(data)) < 0)
 		return false;
 
-	while (fgets(buf, sizeof(buf), fp)) {
-		sscanf(buf, "%[^=]=%s", key, val);
+	for (line = data; *line; line = next) {
+		if ((next = strchr(line, '\n')))
+			*next++ = '\0';
+		else
+			next = line + strlen(line);
+		sscanf(line, "%31[^=]=%31s", key, val);
 
 		switch (battery_parse_key(key)) {
 		case BAT_KEY_STATUS:
@@ -161,8 +193,9 @@ battery_load_info(battery_t *bat, const char *path)
 			break;
 		}
 	}
-	fclose(fp);
 
+	if (!full)
+		return false;
 	bat->capacity = now * 100 / full;
 
 	return true;
@@ -175,7 +208,7 @@ battery_load_info(battery_t *bat, const char *path)
 #include <unistd.h>
 
 bool
-battery_load_info(battery_t *bat, const char *unused)
+battery_load_info(battery_t *bat, module_option_t *unused)
 {
 	static int fd = 0;
 	struct apm_power_info info;
@@ -213,7 +246,7 @@ battery_load_info(battery_t *bat, const char *unused)
 #include <unistd.h>
 
 bool
-battery_load_info(battery_t *bat, const char *unused)
+battery_load_info(battery_t *bat, module_option_t *unused)
 {
 	static int fd = 0;
 	struct apm_info info;
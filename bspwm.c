@@ -1,6 +1,7 @@
 /* See LICENSE file for copyright and license details. */
 
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,8 +11,12 @@
 
 #include "bspwmbar.h"
 #include "bspwm.h"
+#include "snapshot.h"
 #include "util.h"
 
+/* size of the buffer for reports */
+#define REPORT_BUFSZ 8192
+
 struct _bspwm_desktop_t {
 	char *name;
 	bspwm_desktop_state_t state;
@@ -36,16 +41,26 @@ typedef struct {
 static void bspwm_init();
 static int bspwm_connect();
 static int bspwm_disconnect();
-static int bspwm_send(const char*, size_t);
-static void bspwm_parse(const char *);
+static int bspwm_release();
+static int bspwm_send(int, const char*, size_t);
+static void bspwm_parse(bspwm_t *, const char *);
+static void bspwm_free(void *);
 static poll_result_t bspwm_handle(int);
 
 /* file descriptior for bspwm */
 static poll_fd_t pfd = { 0 };
-static bspwm_t *bspwm = NULL;
+/* bspwm_t of the last report, read by the render thread */
+static snapshot_t report = NULL;
+/* received reports, the last complete one is kept at the head */
+static char rbuf[REPORT_BUFSZ];
+static size_t rlen = 0;
 
 /**
- * bspwm_connect() - connect to bspwm socket.
+ * bspwm_connect() - connect to bspwm socket and subscribe reports.
+ *
+ * The socket is non-blocking, so a bspwm which is not accepting connections
+ * fails the connect instead of blocking the event thread. It is called
+ * again by the poll supervisor on failures.
  *
  * Return: file descripter or -1.
  */
@@ -57,7 +72,7 @@ bspwm_connect()
 	char *sp = NULL;
 
 	sock.sun_family = AF_UNIX;
-	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+	if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1)
 		return -1;
 
 	sp = getenv("BSPWM_SOCKET");
@@ -70,8 +85,13 @@ bspwm_connect()
 		free(sp);
 	}
 
-	if (connect(fd, (struct sockaddr *)&sock, sizeof(sock)) == -1)
+	if (connect(fd, (struct sockaddr *)&sock, sizeof(sock)) == -1 ||
+	    bspwm_send(fd, SUBSCRIBE_REPORT, LENGTH(SUBSCRIBE_REPORT)) == -1) {
+		close(fd);
 		return -1;
+	}
+	/* drop the incomplete report of the previous connection */
+	rlen = 0;
 
 	return fd;
 }
@@ -79,11 +99,37 @@ bspwm_connect()
 int
 bspwm_disconnect()
 {
+	close(pfd.fd);
+	return 0;
+}
+
+/**
+ * bspwm_release() - release the last report.
+ *
+ * The report is kept while bspwm is restarting, so desktops are shown until
+ * the new connection reports.
+ *
+ * Return: 0
+ */
+int
+bspwm_release()
+{
+	snapshot_publish(&report, NULL, bspwm_free);
+	return 0;
+}
+
+/**
+ * bspwm_free() - free the state of a report.
+ * @data: bspwm_t
+ */
+void
+bspwm_free(void *data)
+{
+	bspwm_t *bspwm = data;
 	bspwm_monitor_t *mon;
 	bspwm_desktop_t *desk;
 	list_head *cur, *tmp, *cur2, *tmp2;
 
-	close(pfd.fd);
 	list_for_each_safe(&bspwm->monitors, cur, tmp) {
 		mon = list_entry(cur, bspwm_monitor_t, head);
 		list_for_each_safe(&mon->desktops, cur2, tmp2) {
@@ -95,38 +141,32 @@ bspwm_disconnect()
 		free(mon);
 	}
 	free(bspwm);
-	return 0;
 }
 
 void
 bspwm_init()
 {
-	bspwm = calloc(1, sizeof(bspwm_t));
-
-	list_head_init(&bspwm->monitors);
-
 	pfd.fd = bspwm_connect();
 	pfd.init = bspwm_connect;
 	pfd.deinit = bspwm_disconnect;
+	pfd.release = bspwm_release;
 	pfd.handler = bspwm_handle;
+	pfd.name = "bspwm";
 	poll_add(&pfd);
-
-	/* subscribe bspwm report */
-	bspwm_send(SUBSCRIBE_REPORT, LENGTH(SUBSCRIBE_REPORT));
 }
 
 /**
  * bspwm_send() - send specified command to bspwm.
- * @bspwm: bspwm.
+ * @fd: bspwm socket.
  * @cmd: bspwm command.
  * @len: length of cmd.
  *
  * Return: sent bytes length.
  */
 int
-bspwm_send(const char *cmd, size_t len)
+bspwm_send(int fd, const char *cmd, size_t len)
 {
-	return send(pfd.fd, cmd, len, 0);
+	return send(fd, cmd, len, MSG_NOSIGNAL);
 }
 
 /**
@@ -152,8 +192,13 @@ bspwm_desktop_state_parse(char s)
 	return state;
 }
 
+/**
+ * bspwm_parse() - parse the report into the empty state.
+ * @bspwm: bspwm_t
+ * @report: bspwm report.
+ */
 void
-bspwm_parse(const char *report)
+bspwm_parse(bspwm_t *bspwm, const char *report)
 {
 	int i, j;
 	int len = strlen(report);
@@ -232,29 +277,68 @@ bspwm_parse(const char *report)
  * @fd: a file descriptor for bspwm socket.
  *
  * This function expects call after bspwm_connect().
- * Read and parse bspwm report from fd.
+ * Read all reports available on fd, then parse the last complete one and
+ * publish it as the state read by desktops(). Every report lists all
+ * monitors and desktops, so older reports are skipped and the state is built
+ * from scratch, and never modified after it has been published.
+ * An incomplete report is kept until the rest arrives.
  *
  * Return: poll_result_t
  *
  * success and not need more action - PR_NOOP
  * success and need rerendering     - PR_UPDATE
- * failed to read from fd           - PR_FAILED
+ * failed to read from fd           - PR_FAILED, bspwm is reconnected
  */
 poll_result_t
 bspwm_handle(int fd)
 {
-	ssize_t len;
-
-	if ((len = recv(fd, buf, sizeof(buf) - 1, 0)) > 0) {
-		buf[len] = '\0';
-		if (buf[0] == '\x07') {
-			err("bspwm: %s", buf + 1);
-			return PR_FAILED;
+	size_t complete = 0, start = 0, end, i;
+	bspwm_t *bspwm;
+	ssize_t n;
+	char c;
+
+	/* keep the last complete report at the head of rbuf */
+	for (;;) {
+		/* a report longer than the buffer is dropped */
+		if (rlen >= sizeof(rbuf) - 1)
+			rlen = complete = 0;
+		if ((n = recv(fd, rbuf + rlen, sizeof(rbuf) - 1 - rlen, MSG_DONTWAIT)) <= 0)
+			break;
+		for (i = rlen, end = complete; i < rlen + n; i++) {
+			if (rbuf[i] != '\n')
+				continue;
+			pfd.nevent++;
+			start = end;
+			end = i + 1;
+		}
+		rlen += n;
+		if (end > complete) {
+			memmove(rbuf, rbuf + start, rlen - start);
+			rlen -= start;
+			complete = end - start;
 		}
-		bspwm_parse(buf);
-		return PR_UPDATE;
 	}
-	return PR_FAILED;
+	if (!n || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+		return PR_FAILED;
+	if (rlen && rbuf[0] == '\x07') {
+		rbuf[rlen] = '\0';
+		err("bspwm: %s", rbuf + 1);
+		return PR_FAILED;
+	}
+	if (!complete)
+		return PR_NOOP;
+
+	c = rbuf[complete];
+	rbuf[complete] = '\0';
+	bspwm = calloc(1, sizeof(bspwm_t));
+	list_head_init(&bspwm->monitors);
+	bspwm_parse(bspwm, rbuf);
+	snapshot_publish(&report, bspwm, bspwm_free);
+	rbuf[complete] = c;
+
+	memmove(rbuf, rbuf + complete, rlen - complete);
+	rlen -= complete;
+	return PR_UPDATE;
 }
 
 bspwm_desktop_state_t
@@ -266,7 +350,6 @@ bspwm_desktop_state(bspwm_desktop_t *desktop)
 void
 draw_desktop(draw_context_t *dc, bspwm_desktop_t *desktop, module_desktop_t *opts)
 {
-	const char *ws;
 	bspwm_desktop_state_t state = bspwm_desktop_state(desktop);
 
 	color_t *col;
@@ -276,10 +359,12 @@ draw_desktop(draw_context_t *dc, bspwm_desktop_t *desktop, module_desktop_t *opt
 	if (!fg_free)
 		fg_free = opts->fg_free ? color_load(opts->fg_free) : color_default_fg();
 
-	ws = (state & BSPWM_DESKTOP_FOCUSED) ? opts->focused : opts->unfocused;
 	col = (state == BSPWM_DESKTOP_FREE) ? fg_free : fg;
 
-	draw_color_text(dc, col, ws);
+	if (state & BSPWM_DESKTOP_FOCUSED)
+		draw_color_text_run(dc, col, &opts->focused_run, opts->focused);
+	else
+		draw_color_text_run(dc, col, &opts->unfocused_run, opts->unfocused);
 }
 
 /**
@@ -293,10 +378,13 @@ desktops(draw_context_t *dc, module_option_t *opts)
 	const char *name = draw_context_monitor_name(dc);
 	bspwm_monitor_t *mon = NULL;
 	bspwm_desktop_t *desktop;
+	bspwm_t *bspwm;
 	list_head *cur;
 
-	if (!bspwm)
+	if (!pfd.handler)
 		bspwm_init();
+	if (!(bspwm = snapshot_get(&report)))
+		return;
 
 	list_for_each(&bspwm->monitors, cur) {
 		mon = list_entry(cur, bspwm_monitor_t, head);
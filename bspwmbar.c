@@ -8,14 +8,20 @@
 # include <sys/timerfd.h>
 # include <sys/un.h>
 #elif defined(__OpenBSD__) || defined(__FreeBSD__)
+# include <errno.h>
 # include <sys/types.h>
 # include <sys/event.h>
 # include <sys/time.h>
 #endif
 
 /* common libraries */
+#include <assert.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <locale.h>
+#include <pthread.h>
 #include <signal.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -29,6 +35,7 @@
 
 /* XCB */
 #include <xcb/xcb.h>
+#include <xcb/xcbext.h>
 #include <xcb/shm.h>
 #include <xcb/xcb_util.h>
 #include <xcb/xcb_ewmh.h>
@@ -49,7 +56,12 @@
 /* local headers */
 #include "bspwmbar.h"
 #include "bspwm.h"
+#include "fontcache.h"
 #include "systray.h"
+#include "collect.h"
+#include "snapshot.h"
+#include "timer.h"
+#include "workqueue.h"
 #include "config.h"
 
 #if !defined(VERSION)
@@ -58,10 +70,57 @@
 
 /* epoll max events */
 #define MAX_EVENTS 10
+/* max number of cached glyph runs */
+#define RUN_CACHE_SIZE 128
+/* number of hash buckets for glyph runs */
+#define RUN_CACHE_NBUCKET 64
+/* number of runes per page of the coverage table */
+#define COVERAGE_PAGE_BITS 8
+#define COVERAGE_PAGE_SIZE (1 << COVERAGE_PAGE_BITS)
+#define COVERAGE_NPAGE     ((0x10FFFF >> COVERAGE_PAGE_BITS) + 1)
+/* font index of the coverage table entries */
+#define COVERAGE_UNKNOWN 0
+#define COVERAGE_PRIMARY 1
+#define COVERAGE_PENDING (UINT16_MAX - 1)
+#define COVERAGE_MISSING UINT16_MAX
+/* max number of runes waiting for fallback font resolution */
+#define FONT_QUEUE_SIZE 64
+/* labels recorded per rune pending on the font worker */
+#define FONT_WAITERS 4
+/* max number of labels waiting for re-rendering */
+#define RENDER_QUEUE_SIZE 16
+/* max number of loaded fallback fonts */
+#define FONT_CACHE_SIZE 16
+/* initial size of the per-frame arena of draw context */
+#define ARENA_SIZE 16384
+/* size of the active window title buffer */
+#define TITLE_BUFSZ 4096
+/* characters drawn by draw_numeric() without shaping */
+#define NUMERIC_CHARS "0123456789+-%.,:/ "
+/* initial capacity of glyph metrics cache per font */
+#define METRICS_CACHE_SIZE 64
+/* min interval of frames in milliseconds */
+#define FRAME_INTERVAL (FRAME_RATE ? 1000 / FRAME_RATE : 0)
+/* milliseconds of a step of the wall clock or a suspend treated as a jump */
+#define CLOCK_JUMP 1000
+
+/* clocks whose difference grows while the system is suspended */
+#if defined(__linux)
+# define CLOCK_ASLEEP CLOCK_BOOTTIME
+# define CLOCK_AWAKE  CLOCK_MONOTONIC
+#elif defined(__OpenBSD__)
+# define CLOCK_ASLEEP CLOCK_MONOTONIC
+# define CLOCK_AWAKE  CLOCK_UPTIME
+#endif
 /* convert color for cairo */
 #define CONVCOL(x) (double)((x) / 255.0)
+/* convert between pixels and 26.6 fixed point */
+#define TO_26_6(x) ((int32_t)((x) * 64 + ((x) < 0 ? -0.5 : 0.5)))
+#define ROUND_26_6(x) (((x) + 32) / 64)
+#define CEIL_26_6(x) (((x) + 63) / 64)
+#define FLOOR_26_6(x) (((x) & ~63) / 64)
 /* check event and returns true if target is the label */
-#define IS_LABEL_EVENT(l,e) (((l).x < (e)->event_x) && ((e)->event_x < (l).x + (l).width))
+#define IS_LABEL_EVENT(l,e) (((l).hitx < (e)->event_x) && ((e)->event_x < (l).hitx + (l).hitwidth))
 
 struct _color_t {
 	char *name;
@@ -76,10 +135,45 @@ typedef struct {
 	xcb_shm_segment_info_t shm_info;
 } pixmap_t;
 
+/* advance and ink extents of a glyph in 26.6 fixed point */
+typedef struct {
+	FT_UInt glyph; /* glyph index + 1, 0 is empty slot */
+	int32_t x_advance;
+	int32_t x_bearing, y_bearing;
+	int32_t width, height;
+
+	/* rasterized color glyph */
+	bool rastered;
+	bool bitmap; /* a BGRA bitmap drawn from raster, others use the color of labels */
+	cairo_surface_t *raster; /* NULL if the glyph has no ink */
+	int raster_x, raster_y; /* offset from the glyph origin */
+	int raster_w, raster_h;
+} glyph_metrics_t;
+
+/* pre-shaped glyph of a numeric character */
+typedef struct {
+	FT_UInt glyph; /* 0 if the font can not draw the character */
+	hb_position_t advance;
+	hb_position_t offset; /* to center digits in tabular width */
+} numeric_glyph_t;
+
 typedef struct {
 	FT_Face face;
 	cairo_font_face_t *cairo;
 	hb_font_t *hb;
+
+	/* open addressing table of measured glyphs */
+	glyph_metrics_t *metrics;
+	size_t nmetric, metriccap;
+	/* glyphs of NUMERIC_CHARS indexed by ASCII code */
+	numeric_glyph_t *numerics;
+	/* advances of ASCII glyphs of the primary font, -1 if not resolved to it */
+	int32_t *ascii;
+
+	char *path; /* font file of fallback fonts */
+	int index;
+	unsigned long used; /* frame number of last use */
+	int npin; /* glyphs of text runs referring the font, never evicted while set */
 } font_t;
 
 typedef struct {
@@ -87,13 +181,205 @@ typedef struct {
 	cairo_glyph_t glyph;
 } glyph_font_spec_t;
 
+/* candidate of fallback fonts sorted by fontconfig */
+typedef struct {
+	FcPattern *pattern;
+	FcCharSet *charset;
+} fallback_t;
+
+/* rune requested to the font worker */
+typedef struct {
+	FcChar32 rune;
+	char *path; /* font file found by the persistent cache or NULL */
+	int index;
+} font_request_t;
+
+/* result of fallback font resolution */
+typedef struct {
+	FcChar32 rune;
+	font_t *font; /* loaded by the worker, NULL if no font contains the rune */
+	FT_UInt glyph;
+	bool record; /* found by fontconfig, recorded to the persistent cache */
+} font_result_t;
+
+/* labels drawn with the primary font until the rune is resolved */
+typedef struct {
+	FcChar32 rune;
+	module_option_t *opts[FONT_WAITERS];
+	int nopt; /* over FONT_WAITERS if the whole frame should be rendered */
+	bool done;
+} font_waiter_t;
+
+/* background worker for fallback font resolution */
+typedef struct {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	bool running;
+
+	/* requested runes */
+	font_request_t requests[FONT_QUEUE_SIZE];
+	int head, nrune;
+	/* resolved runes */
+	font_result_t results[FONT_QUEUE_SIZE];
+	int nresult;
+	/* requested and not yet consumed runes */
+	int noutstanding;
+	/* labels to render when runes are resolved */
+	font_waiter_t waiters[FONT_QUEUE_SIZE];
+	int nwaiter;
+	bool full; /* some waiters were not recorded */
+
+	int pipe[2];
+	poll_fd_t pollfd;
+} font_worker_t;
+
+/* thread rendering frames requested by the event thread */
+typedef struct {
+	pthread_t thread;
+	pthread_mutex_t lock; /* requests and hit boxes of labels */
+	pthread_cond_t cond;
+	pthread_mutex_t frame; /* held while a frame is rendered */
+	bool running;
+	bool busy; /* a frame is in flight */
+	void (* render)();
+
+	/* requested whole frame and labels */
+	bool full;
+	module_option_t *opts[RENDER_QUEUE_SIZE];
+	int nopt;
+
+	/* wakes the event thread after frames */
+	int pipe[2];
+	poll_fd_t pollfd;
+} renderer_t;
+
+/* continuation of an asynchronous request */
+struct _async_t {
+	async_func_t func;
+	void *data;
+	unsigned int sequence; /* xcb request */
+	poll_fd_t pollfd; /* fd request, fd is -1 for xcb requests */
+	timer_entry_t timer; /* deadline */
+
+	list_head head;
+};
+
+/* restart of a failed poll source */
+typedef struct {
+	poll_fd_t *pollfd;
+	timer_entry_t timer;
+	unsigned int backoff; /* delay of the next restart in milliseconds */
+	uint64_t up; /* when the source has been restarted */
+
+	list_head head;
+} poll_restart_t;
+
+/* scroll wheel steps of a module waiting to be applied */
+typedef struct {
+	module_option_t *opts;
+	scroll_apply_t apply;
+	int steps;
+	timer_entry_t timer;
+
+	list_head head;
+} scroll_t;
+
+/* title request of the active window */
+typedef struct {
+	unsigned long gen;
+	bool done; /* reply of _NET_WM_NAME has been taken */
+	bool found; /* _NET_WM_NAME has been published */
+} title_request_t;
+
 static glyph_font_spec_t glyph_caches[1024];
 
+/* resolved font and glyph index of a rune */
+typedef struct {
+	uint16_t font; /* COVERAGE_* or index of fcaches + 2 */
+	FT_UInt glyph;
+} coverage_entry_t;
+
+/* sample of an offloaded sampler, the worker only touches next and result */
+typedef struct {
+	work_t work;
+	work_t *queued; /* work running the sample, its own or a batch */
+	module_option_t *opts;
+	const module_sampler_t *sampler;
+	module_sched_t *sched;
+	void *next; /* state updated by the worker */
+	bool result; /* return value of the update */
+	bool abandoned; /* overran SAMPLER_TIMEOUT, the sched has got a new sample */
+} sched_sample_t;
+
+/* scheduled sampler of a module */
+struct _module_sched_t {
+	module_option_t *opts;
+	const module_sampler_t *sampler;
+	void *state;
+	snapshot_t shown; /* copy of state read by the render thread */
+	bool predicted; /* shown is a state given by module_predict() */
+	timer_entry_t timer;
+
+	/* sampling on the worker pool */
+	sched_sample_t *sample; /* NULL if sampled on the event thread */
+	uint64_t started;
+	bool busy; /* a sample is in flight */
+	bool refresh; /* present the sample immediately */
+	atomic_bool stale; /* an abandoned sample is in flight, read by frames */
+	bool again; /* sample again after the current one */
+	bool reset; /* drop baselines before the next sample */
+
+	list_head head;
+};
+
+/* samplers reading kept files due at the same tick */
+typedef struct {
+	work_t work;
+	int n;
+	sched_sample_t *samples[];
+} sched_batch_t;
+
+/* constant string shaped once */
+struct _text_run_t {
+	char *str;
+	glyph_font_spec_t *glyphs;
+	int nglyph;
+	int width;
+	bool complete; /* false if some runes were not resolved yet */
+
+	list_head head;
+};
+
+typedef struct {
+	uint32_t hash;
+	char *str;
+	font_t *font; /* base font */
+	glyph_font_spec_t *glyphs;
+	int nglyph;
+	int width;
+
+	list_head lru;
+	list_head bucket;
+} glyph_run_t;
+
+typedef struct {
+	glyph_run_t runs[RUN_CACHE_SIZE];
+	int nrun;
+
+	list_head lru; /* most recently used first */
+	list_head buckets[RUN_CACHE_NBUCKET];
+
+	unsigned long hits;
+	unsigned long misses;
+} glyph_run_cache_t;
+
 typedef struct {
 	module_option_t *option;
 	color_t fg, bg;
 
 	int x, width;
+	int hitx, hitwidth; /* of the presented frame, read by the event thread */
 } label_t;
 
 typedef int desktop_state_t;
@@ -124,6 +410,19 @@ typedef struct {
 	int x, y, width, height;
 } window_t;
 
+/* bump allocator reset on every frame */
+typedef union _arena_block_t {
+	union _arena_block_t *next;
+	char align[16];
+} arena_block_t;
+
+typedef struct {
+	char *base;
+	size_t size, used;
+	size_t peak; /* bytes requested in the frame including overflow */
+	arena_block_t *overflow; /* heap blocks used when base is exhausted */
+} arena_t;
+
 struct _draw_context_t {
 	window_t xbar;
 	char monitor_name[NAME_MAXSZ];
@@ -136,9 +435,14 @@ struct _draw_context_t {
 	cairo_t *cr;
 
 	int x, width;
+	bool stale; /* the label being drawn shows an abandoned sample */
+
+	label_t *left_labels;
+	size_t nleft;
+	label_t *right_labels;
+	size_t nright;
 
-	label_t left_labels[LENGTH(left_modules)];
-	label_t right_labels[LENGTH(right_modules)];
+	arena_t arena;
 };
 
 typedef struct {
@@ -154,6 +458,8 @@ typedef struct {
 	cairo_font_options_t *font_opt;
 	FcPattern *pattern;
 	FcFontSet *set;
+	fallback_t *fallbacks;
+	fontcache_t *fontcache;
 
 	/* draw context */
 	draw_context_t *dcs;
@@ -161,6 +467,7 @@ typedef struct {
 
 	/* base color */
 	color_t *fg, *bg;
+	color_t *stale; /* fg of modules whose samples are abandoned */
 } bspwmbar_t;
 
 /* temporary buffer */
@@ -171,62 +478,193 @@ static systray_t *tray;
 static poll_fd_t xfd;
 #if defined(__linux)
 static poll_fd_t timer;
+static poll_fd_t clockfd;
 #endif
 
 static FT_Int32 load_flag = FT_LOAD_COLOR | FT_LOAD_NO_BITMAP | FT_LOAD_NO_AUTOHINT;
 static FT_Library ftlib;
+/* FT_New_Face() and FT_Done_Face() of ftlib on the render thread and the font worker */
+static pthread_mutex_t ftlock = PTHREAD_MUTEX_INITIALIZER;
 
 static color_t **cols;
 static int ncol, colcap;
-static font_t *fcaches;
+static font_t **fcaches;
 static int nfcache = 0;
 static int fcachecap = 0;
+static unsigned long nfevict = 0;
+static unsigned long nfoverrun = 0; /* fonts loaded over FONT_CACHE_SIZE */
+static unsigned long nframe = 0;
+static unsigned long nraster = 0;
+/* heap allocations of caches and arenas of the bar on rendering */
+static unsigned long nalloc = 0;
+static unsigned long nallocframe = 0;
+#ifndef NDEBUG
+/* hash of glyphs drawn and runes measured by the frame, equal for repeated frames */
+static uint32_t frame_hash = 0;
+# define FRAME_HASH(v) (frame_hash = (frame_hash ^ (uint32_t)(v)) * 16777619)
+#else
+# define FRAME_HASH(v) ((void)0)
+#endif
+static hb_buffer_t *shape_buffer;
 static int celwidth = 0;
 static int graph_maxh = 0;
 static int graph_basey = 0;
+static glyph_run_cache_t run_cache;
+static coverage_entry_t *coverage[COVERAGE_NPAGE];
+static font_worker_t fworker;
+/* module whose label is being drawn, waiting for runes pending on the font worker */
+static module_option_t *draw_option = NULL;
+static renderer_t renderer = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.frame = PTHREAD_MUTEX_INITIALIZER,
+};
+static unsigned long nmerge = 0;
+static unsigned long ninflight = 0;
+/* restarts of failed poll sources */
+static list_head restarts;
+/* asynchronous requests, xcb ones in order of sequence numbers */
+static list_head async_xcbs;
+static list_head async_fds;
+static list_head async_dead; /* fd requests freed after the poll batch */
+static unsigned long nasync = 0;
+static unsigned long nasync_timeout = 0;
+static unsigned long nasync_inflight = 0;
+static unsigned long nasync_peak = 0;
+static list_head text_runs;
+static timer_wheel_t *wheel;
+static list_head scheds;
+static bool sched_changed = false;
+static workqueue_t *sched_wq;
+static module_sched_t **sched_pending;
+static int npending = 0, pendingcap = 0;
+static bool sched_batching = false;
+static poll_fd_t sched_pollfd;
+static list_head scrolls;
+static unsigned long nscroll = 0;
+static unsigned long nscrollapply = 0;
+static unsigned long noffload = 0;
+static unsigned long noverrun = 0;
+static unsigned long ntimeout = 0;
+static unsigned long nclockset = 0;
+static unsigned long nresume = 0;
+/* offsets of the wall clock and of suspended time to timer_now() */
+static int64_t clock_wall = 0;
+static int64_t clock_asleep = 0;
+/* render requests are coalesced into one frame per FRAME_INTERVAL */
+static bool frame_dirty = false;
+static uint64_t frame_last = 0;
+static unsigned long ncoalesce = 0;
+/* wakeups of the poll loop */
+static unsigned long nwakeup = 0;
+static unsigned long nwakeup_window = 0;
+static unsigned long wakeups_per_min = 0;
+static uint64_t wakeup_window = 0;
+static volatile sig_atomic_t stats_requested = 0;
 
 /* EWMH */
 static xcb_ewmh_connection_t ewmh;
 static xcb_atom_t xembed_info;
 
-/* Window title cache */
-static char *wintitle = NULL;
+/* Window title, NULL if no title */
+static snapshot_t wintitle = NULL;
+static unsigned long title_gen = 0;
 
 /* polling fd */
 static int pfd = 0;
 #if defined(__linux)
-static struct epoll_event events[MAX_EVENTS];
+typedef struct epoll_event poll_event_t;
+# define EVENT_POLLFD(ev) ((poll_fd_t *)(ev).data.ptr)
 #elif defined(__OpenBSD__) || defined(__FreeBSD__)
-static struct kevent events[MAX_EVENTS];
+typedef struct kevent poll_event_t;
+# define EVENT_POLLFD(ev) ((poll_fd_t *)(ev).udata)
 #endif
+static poll_event_t events[MAX_EVENTS];
 static list_head pollfds;
 
 /* private functions */
 static void color_load_hex(const char *, color_t *);
 static bool color_load_name(const char *, color_t *);
 static void signal_handler(int);
-static xcb_window_t get_active_window(uint8_t scrno);
 static xcb_visualtype_t *xcb_visualtype_get(xcb_screen_t *);
 static bool xcb_shm_support(xcb_connection_t *);
 static void xcb_gc_color(xcb_connection_t *, xcb_gcontext_t, color_t *);
-static char *get_window_title(xcb_connection_t *, xcb_window_t);
 static FT_UInt get_font(FcChar32 rune, font_t **);
+static bool rune_missing(FcChar32);
+static FT_UInt find_font(FcChar32 rune, font_t **);
+static font_t *font_new(FT_Face, const char *, int);
+static font_t *font_cache_add(font_t *);
+static font_t *font_cache_find(const char *, int);
+static int font_cache_evict();
+static FcFontSet *fallback_fonts();
+static bool fallback_lookup(FcChar32, char **, int *);
+static bool font_worker_start();
+static bool font_waiter_add(font_worker_t *, FcChar32, bool);
+static bool font_worker_request(FcChar32, const char *, int);
+static void font_worker_wait(FcChar32);
+static font_t *font_open(font_worker_t *, const char *, int, FcChar32, FT_UInt *);
+static void font_worker_load(font_worker_t *, const font_request_t *, font_result_t *);
+static void *font_worker_run(void *);
+static poll_result_t font_worker_handle(int);
+static void font_worker_apply();
+static int font_worker_stop();
+static coverage_entry_t *coverage_get(FcChar32);
+static unsigned long *coverage_count();
+static void coverage_set(coverage_entry_t *, font_t *, FT_UInt);
+static void coverage_invalidate(uint16_t);
+static void coverage_destroy();
 static bool load_fonts(const char *);
 static void font_destroy(font_t font);
-static size_t load_glyphs_from_hb_buffer(draw_context_t *, hb_buffer_t *, font_t *, int *, int, glyph_font_spec_t *, size_t);
+static glyph_metrics_t *glyph_metrics_get(draw_context_t *, font_t *, FT_UInt);
+static glyph_metrics_t *glyph_raster_get(draw_context_t *, font_t *, FT_UInt);
+static void glyph_metrics_destroy(font_t *);
+static size_t font_cache_bytes(const font_t *);
+static size_t load_glyphs_from_hb_buffer(draw_context_t *, hb_buffer_t *, font_t *, hb_position_t *, int, glyph_font_spec_t *, size_t);
 static int load_glyphs(draw_context_t *, const char *, glyph_font_spec_t *, int, int *);
+static int shape_glyphs(draw_context_t *, const char *, glyph_font_spec_t *, int, int *, bool *);
+static text_run_t *text_run_new(draw_context_t *, const char *);
+static void text_run_shape(draw_context_t *, text_run_t *);
+static void text_runs_init(draw_context_t *, module_t *, size_t);
+static void text_runs_destroy();
+static void text_run_unpin(text_run_t *);
+static int32_t *ascii_advances(draw_context_t *);
+static size_t title_truncate(draw_context_t *, const char *, size_t, int, int, bool *);
+static void dc_arena_reset(draw_context_t *);
+static void glyph_run_cache_init();
+static void glyph_run_cache_destroy();
+static glyph_run_t *glyph_run_lookup(const char *, uint32_t);
+static void glyph_run_store(const char *, uint32_t, const glyph_font_spec_t *, int, int);
+static void glyph_run_invalidate(font_t *);
+static void stats_dump();
 static bool xcb_create_pixmap_with_shm(xcb_connection_t *, xcb_screen_t *, xcb_pixmap_t, uint32_t, uint32_t, xcb_shm_segment_info_t *);
 static pixmap_t *pixmap_new(xcb_connection_t *, xcb_screen_t *, uint32_t, uint32_t);
 static void pixmap_free(pixmap_t *);
-static bool dc_init(draw_context_t *, xcb_connection_t *, xcb_screen_t *, int, int, int, int);
+static monitor_modules_t *monitor_modules_find(const char *, bool);
+static bool dc_init(draw_context_t *, xcb_connection_t *, xcb_screen_t *, monitor_modules_t *, int, int, int, int);
 static void dc_free(draw_context_t);
 static int dc_get_x(draw_context_t *);
 static void dc_move_x(draw_context_t *, int);
 static void dc_calc_render_pos(draw_context_t *, glyph_font_spec_t *, int);
 static void draw_padding(draw_context_t *, int);
 static void draw_glyphs(draw_context_t *, color_t *, const glyph_font_spec_t *, int nglyph);
+static void draw_raster(draw_context_t *, const glyph_metrics_t *, double, double);
+static numeric_glyph_t *numeric_glyphs(draw_context_t *, font_t *);
 static void render_labels(draw_context_t *, label_t *, size_t);
-static void windowtitle_update(xcb_connection_t *, uint8_t);
+static bool render_label(draw_context_t *, label_t *);
+static bool render_option(module_option_t *);
+static void render_frame(bool, module_option_t **, int);
+static void render_request(module_option_t *);
+static void *render_thread_run(void *);
+static bool render_thread_start();
+static void render_thread_stop();
+static void render_thread_wake();
+static poll_result_t render_thread_handle(int);
+static int render_thread_release();
+static void label_hitboxes_update();
+static void windowtitle_request();
+static bool windowtitle_active(void *, void *, bool);
+static bool windowtitle_name(void *, void *, bool);
+static bool windowtitle_set(const char *, size_t);
 static void calculate_systray_item_positions(label_t *, module_option_t *);
 static void calculate_label_positions(draw_context_t *, label_t *, size_t, int);
 static void render();
@@ -236,10 +674,53 @@ static void bspwmbar_destroy();
 static void poll_init();
 static void poll_loop(void (*)());
 static void poll_stop();
+static bool poll_watch(poll_fd_t *);
+static void poll_unwatch(poll_fd_t *);
+static bool poll_fail(poll_fd_t *);
+static poll_restart_t *poll_restart_find(poll_fd_t *);
+static void poll_restart_arm(poll_restart_t *, uint64_t);
+static void poll_restart(timer_entry_t *);
 static poll_result_t xev_handle();
+static poll_result_t xev_dispatch(bool);
+static async_t *async_new(unsigned int, async_func_t, void *);
+static void async_free(async_t *);
+static bool async_finish(async_t *, void *, bool);
+static void async_expire(timer_entry_t *);
+static poll_result_t async_fd_handle(int);
+static poll_result_t async_fd_dead(int);
+static bool async_dispatch();
+static void async_reap();
+static void async_destroy();
 #if defined(__linux)
 static poll_result_t timer_reset(int);
+static void timer_arm(int, int64_t);
+static int clock_watch();
+static int clock_unwatch();
+static poll_result_t clock_update(int);
 #endif
+static int64_t clock_ms(clockid_t);
+static void clock_check(bool);
+static void module_sched_publish(module_sched_t *);
+static void module_sched_arm(module_sched_t *);
+static void module_sched_fire(timer_entry_t *);
+static bool module_stale(module_option_t *);
+static sched_sample_t *module_sched_sample_new(module_sched_t *);
+static void module_sched_sample(module_sched_t *);
+static void module_sched_abandon(module_sched_t *);
+static void module_sched_work(work_t *);
+static void module_sched_done(work_t *);
+static void module_sched_flush();
+static void module_sched_batch_work(work_t *);
+static void module_sched_batch_done(work_t *);
+static poll_result_t module_sched_complete(int);
+static int module_sched_stop();
+static bool module_sched_run();
+static void module_sched_destroy();
+static void scroll_fire(timer_entry_t *);
+static void scroll_destroy();
+static bool frame_ready();
+static int64_t poll_deadline();
+static void wakeup_count();
 static bool is_change_active_window_event(xcb_property_notify_event_t *);
 static void cleanup(xcb_connection_t *);
 static void run();
@@ -314,8 +795,10 @@ color_load(const char *colstr)
 	if (ncol >= colcap) {
 		colcap += 5;
 		cols = realloc(cols, sizeof(color_t *) * colcap);
+		nalloc++;
 	}
 	cols[ncol] = calloc(1, sizeof(color_t));
+	nalloc++;
 
 	if (colstr[0] == '#' && strlen(colstr) > 6)
 		color_load_hex(colstr, cols[ncol]);
@@ -472,11 +955,41 @@ pixmap_free(pixmap_t *pixmap)
 	free(pixmap);
 }
 
+/**
+ * monitor_modules_find() - find module lists for the monitor.
+ * @name: output name of the monitor.
+ * @primary: whether the monitor is the primary monitor.
+ *
+ * Entries are tried in order and the first match wins, so an entry without
+ * output and role matches every monitor and hides entries after it.
+ *
+ * Return: monitor_modules_t * or NULL if no entry matches.
+ */
+monitor_modules_t *
+monitor_modules_find(const char *name, bool primary)
+{
+	monitor_modules_t *mods;
+	size_t i;
+
+	for (i = 0; i < LENGTH(monitor_modules); i++) {
+		mods = &monitor_modules[i];
+		if (mods->output && strncmp(mods->output, name, NAME_MAXSZ))
+			continue;
+		if (mods->role == MONITOR_PRIMARY && !primary)
+			continue;
+		if (mods->role == MONITOR_SECONDARY && primary)
+			continue;
+		return mods;
+	}
+	return NULL;
+}
+
 /**
  * dc_init() - initialize DC.
  * @dc: draw context.
  * @xcb: xcb connection.
  * @scr: screen number.
+ * @mods: module lists for the monitor.
  * @x: window position x.
  * @y: window position y.
  * @width: window width.
@@ -485,8 +998,8 @@ pixmap_free(pixmap_t *pixmap)
  * Return: bool
  */
 bool
-dc_init(draw_context_t *dc, xcb_connection_t *xcb, xcb_screen_t *scr, int x,
-        int y, int width, int height)
+dc_init(draw_context_t *dc, xcb_connection_t *xcb, xcb_screen_t *scr,
+        monitor_modules_t *mods, int x, int y, int width, int height)
 {
 	xcb_configure_window_value_list_t winconf = { 0 };
 	xcb_create_gc_value_list_t gcv = { 0 };
@@ -494,7 +1007,7 @@ dc_init(draw_context_t *dc, xcb_connection_t *xcb, xcb_screen_t *scr, int x,
 	xcb_render_pictforminfo_t *formats;
 	cairo_surface_t *surface;
 	window_t *xw = &dc->xbar;
-	int i = 0;
+	size_t i = 0;
 
 	const uint32_t attrs[] = { bar.bg->pixel, XCB_EVENT_MASK_NO_EVENT };
 
@@ -563,10 +1076,17 @@ dc_init(draw_context_t *dc, xcb_connection_t *xcb, xcb_screen_t *scr, int x,
 	xcb_change_property(xcb, XCB_PROP_MODE_REPLACE, xw->win, XCB_ATOM_WM_CLASS, XCB_ATOM_STRING, 8, 17, "bspwmbar\0bspwmbar");
 
 	/* create labels from modules */
-	for (i = 0; i < (int)LENGTH(left_modules); i++)
-		dc->left_labels[i].option = &left_modules[i];
-	for (i = 0; i < (int)LENGTH(right_modules); i++)
-		dc->right_labels[i].option = &right_modules[i];
+	dc->nleft = mods ? mods->nleft : 0;
+	dc->nright = mods ? mods->nright : 0;
+	dc->left_labels = calloc(dc->nleft, sizeof(label_t));
+	dc->right_labels = calloc(dc->nright, sizeof(label_t));
+	for (i = 0; i < dc->nleft; i++)
+		dc->left_labels[i].option = &mods->left[i];
+	for (i = 0; i < dc->nright; i++)
+		dc->right_labels[i].option = &mods->right[i];
+
+	dc->arena.size = ARENA_SIZE;
+	dc->arena.base = malloc(ARENA_SIZE);
 
 	/* send window rendering request */
 	winconf.stack_mode = XCB_STACK_MODE_BELOW;
@@ -588,6 +1108,10 @@ dc_free(draw_context_t dc)
 	pixmap_free(dc.tmp);
 	xcb_destroy_window(bar.xcb, dc.xbar.win);
 	cairo_destroy(dc.cr);
+	free(dc.left_labels);
+	free(dc.right_labels);
+	dc_arena_reset(&dc);
+	free(dc.arena.base);
 }
 
 const char *
@@ -596,6 +1120,62 @@ draw_context_monitor_name(draw_context_t *dc)
 	return dc->monitor_name;
 }
 
+/**
+ * draw_context_alloc() - allocate memory that lives until the next frame.
+ * @dc: draw context.
+ * @size: size in bytes.
+ *
+ * Memory is taken from the per-frame arena of dc. When the arena is
+ * exhausted, memory is taken from heap and the arena is grown to the peak
+ * on the next frame, so steady frames do no heap allocations.
+ *
+ * Return: void *
+ */
+void *
+draw_context_alloc(draw_context_t *dc, size_t size)
+{
+	arena_t *arena = &dc->arena;
+	arena_block_t *block;
+	void *p;
+
+	size = (size + 15) & ~(size_t)15;
+	arena->peak += size;
+	if (arena->used + size <= arena->size) {
+		p = arena->base + arena->used;
+		arena->used += size;
+		return p;
+	}
+
+	nalloc++;
+	block = malloc(sizeof(arena_block_t) + size);
+	block->next = arena->overflow;
+	arena->overflow = block;
+	return block + 1;
+}
+
+/**
+ * dc_arena_reset() - release all memory allocated in the frame.
+ * @dc: draw context.
+ */
+void
+dc_arena_reset(draw_context_t *dc)
+{
+	arena_t *arena = &dc->arena;
+	arena_block_t *block;
+
+	while ((block = arena->overflow)) {
+		arena->overflow = block->next;
+		free(block);
+	}
+	if (arena->peak > arena->size) {
+		nalloc++;
+		arena->size = arena->peak * 2;
+		free(arena->base);
+		arena->base = malloc(arena->size);
+	}
+	arena->used = arena->peak = 0;
+}
+
 /**
  * dc_get_x() - get next rendering position of DC.
  * @dc: draw context.
@@ -620,64 +1200,118 @@ dc_move_x(draw_context_t *dc, int x)
 }
 
 /**
- * get_active_window() - get active window.
- * @dpy: display pointer.
- * @scr: screen number.
+ * windowtitle_request() - request the title of the active window.
  *
- * Return: xcb_window_t
+ * The active window and its title are fetched by continuations, and the
+ * title is published when their replies arrive. Replies of superseded
+ * requests are dropped.
  */
-xcb_window_t
-get_active_window(uint8_t scrno)
+void
+windowtitle_request()
 {
-	xcb_window_t win;
-	if (xcb_ewmh_get_active_window_reply(&ewmh, xcb_ewmh_get_active_window(&ewmh, scrno), &win, NULL))
-		return win;
-	return 0;
+	title_gen++;
+	async_xcb(xcb_ewmh_get_active_window(&ewmh, 0).sequence, ASYNC_TIMEOUT,
+	          windowtitle_active, (void *)(uintptr_t)title_gen);
 }
 
 /**
- * get_window_title() - get title of specified win.
- * @dpy: display pointer.
- * @win: window.
+ * windowtitle_active() - continuation of the request of the active window.
+ * @data: generation of the request.
+ * @reply: reply of _NET_ACTIVE_WINDOW.
+ * @timedout: true if the reply has not arrived in time.
+ *
+ * Both _NET_WM_NAME and WM_NAME are requested, so the title is fetched in
+ * one round trip whichever the window has.
+ *
+ * Return: true if the title has been cleared.
+ */
+bool
+windowtitle_active(void *data, void *reply, bool timedout)
+{
+	xcb_change_window_attributes_value_list_t attrs;
+	title_request_t *req;
+	xcb_window_t win = 0;
+
+	if (reply && !xcb_ewmh_get_active_window_from_reply(&win, reply))
+		win = 0;
+	free(reply);
+	if ((uintptr_t)data != title_gen || timedout)
+		return false;
+	if (!win)
+		return windowtitle_set(NULL, 0);
+
+	/* wait title changes of the active window */
+	attrs.event_mask = XCB_EVENT_MASK_PROPERTY_CHANGE;
+	xcb_change_window_attributes_aux(bar.xcb, win, XCB_CW_EVENT_MASK, &attrs);
+
+	req = calloc(1, sizeof(title_request_t));
+	req->gen = title_gen;
+	async_xcb(xcb_ewmh_get_wm_name(&ewmh, win).sequence, ASYNC_TIMEOUT, windowtitle_name, req);
+	async_xcb(xcb_get_property(bar.xcb, 0, win, XCB_ATOM_WM_NAME, XCB_ATOM_STRING, 0, NAME_MAXSZ).sequence,
+	          ASYNC_TIMEOUT, windowtitle_name, req);
+	return false;
+}
+
+/**
+ * windowtitle_name() - continuation of the requests of the window title.
+ * @data: title_request_t shared by both requests.
+ * @reply: reply of _NET_WM_NAME on the first call, WM_NAME on the second.
+ * @timedout: true if the reply has not arrived in time.
+ *
+ * WM_NAME is used only if the window has no _NET_WM_NAME. The title is
+ * left as is if the window does not answer in time.
  *
- * Return: unsigned char *
- *         The return value needs free after used.
+ * Return: true if the title has been changed.
  */
-char *
-get_window_title(xcb_connection_t *xcb, xcb_window_t win)
+bool
+windowtitle_name(void *data, void *reply, bool timedout)
 {
-	char *title = NULL;
-	xcb_get_property_reply_t *reply = NULL;
+	title_request_t *req = data;
 	xcb_ewmh_get_utf8_strings_reply_t utf8_reply = { 0 };
+	bool current = req->gen == title_gen && !timedout;
+	bool changed = false;
+
+	if (!req->done) {
+		req->done = true;
+		/* the reply is owned by utf8_reply on success */
+		if (reply && current && xcb_ewmh_get_utf8_strings_from_reply(&ewmh, &utf8_reply, reply)) {
+			changed = windowtitle_set(utf8_reply.strings, utf8_reply.strings_len);
+			xcb_ewmh_get_utf8_strings_reply_wipe(&utf8_reply);
+			req->found = true;
+		} else {
+			free(reply);
+		}
+		return changed;
+	}
 
-	if (xcb_ewmh_get_wm_name_reply(&ewmh, xcb_ewmh_get_wm_name(&ewmh, win), &utf8_reply, NULL)) {
-		title = strndup(utf8_reply.strings, utf8_reply.strings_len);
-		xcb_ewmh_get_utf8_strings_reply_wipe(&utf8_reply);
-	} else if ((reply = xcb_get_property_reply(xcb, xcb_get_property(xcb, 0, win, XCB_ATOM_WM_NAME, XCB_ATOM_STRING, 0, NAME_MAXSZ), NULL))) {
-		title = strndup(xcb_get_property_value(reply), xcb_get_property_value_length(reply));
-		free(reply);
+	if (current && !req->found) {
+		if (reply)
+			changed = windowtitle_set(xcb_get_property_value(reply), xcb_get_property_value_length(reply));
+		else
+			changed = windowtitle_set(NULL, 0);
 	}
-	return title;
+	free(reply);
+	free(req);
+	return changed;
 }
 
 /**
- * windowtitle_update() - update windowtitle() returns value.
- * @dpy: display pointer.
- * @scr: screen number.
+ * windowtitle_set() - publish the window title for the render thread.
+ * @str: title, not terminated.
+ * @len: length of str.
+ *
+ * Return: false if the title is not changed.
  */
-void
-windowtitle_update(xcb_connection_t *xcb, uint8_t scrno)
+bool
+windowtitle_set(const char *str, size_t len)
 {
-	xcb_window_t win;
-	if ((win = get_active_window(scrno))) {
-		if (wintitle)
-			free(wintitle);
-		wintitle = get_window_title(xcb, win);
-	} else {
-		/* release wintitle when active window not found */
-		free(wintitle);
-		wintitle = NULL;
-	}
+	const char *cur = snapshot_get(&wintitle);
+
+	len = SMALLER(len, TITLE_BUFSZ - 1);
+	if (cur ? (strlen(cur) == len && !memcmp(cur, str, len)) : !len)
+		return false;
+	snapshot_publish(&wintitle, len ? strndup(str, len) : NULL, free);
+	return true;
 }
 
 /**
@@ -688,788 +1322,3773 @@ windowtitle_update(xcb_connection_t *xcb, uint8_t scrno)
 void
 windowtitle(draw_context_t *dc, module_option_t *opts)
 {
-	if (!wintitle)
-		return;
+	const char *cur = snapshot_get(&wintitle);
 
-	FcChar32 dst;
-	size_t i = 0, titlelen = strlen(wintitle);
-	strncpy(buf, wintitle, sizeof(buf));
-	for (size_t len = 0; i < titlelen && len < opts->title.maxlen; len++)
-		i += FcUtf8ToUcs4((FcChar8 *)&wintitle[i], &dst, strlen(wintitle) - i);
-	if (i < strlen(buf))
-		strncpy(&buf[i], opts->title.ellipsis, sizeof(buf) - i);
+	if (!cur)
+		return;
 
-	draw_text(dc, buf);
+	bool truncated;
+	int reserve = 0;
+	size_t len;
+	char *title;
+
+	if (opts->title.ellipsis_run)
+		reserve = opts->title.ellipsis_run->width;
+	len = title_truncate(dc, cur, opts->title.maxlen, opts->title.maxwidth, reserve, &truncated);
+	title = draw_context_alloc(dc, len + 1);
+	memcpy(title, cur, len);
+	title[len] = '\0';
+
+	draw_text(dc, title);
+	if (truncated)
+		draw_text_run(dc, &opts->title.ellipsis_run, opts->title.ellipsis);
 }
 
 /**
- * get_font() - finds a font that renderable specified rune.
- * @rune: FcChar32
+ * ascii_advances() - get advances of ASCII glyphs of the primary font.
+ * @dc: draw context.
  *
- * Return: FT_Face
+ * The table is filled once. Control characters and characters drawn by
+ * fallback fonts or not resolved yet are -1 and measured by title_truncate() one by one, so the
+ * table never has to be invalidated.
+ *
+ * Return: advances in 26.6 fixed point indexed by ASCII code.
  */
-FT_UInt
-get_font(FcChar32 rune, font_t **font)
+int32_t *
+ascii_advances(draw_context_t *dc)
 {
-	FcResult result;
-	FcFontSet *fonts;
-	FcPattern *pat;
-	FcCharSet *charset;
-	FcChar8 *path;
-	FT_Face face;
-	int i, idx;
-
-	/* Lookup character index with default font. */
-	if ((idx = FT_Get_Char_Index(bar.font.face, rune))) {
-		*font = &bar.font;
-		return idx;
-	}
-
-	/* fallback on font cache */
-	for (i = 0; i < nfcache; i++) {
-		if ((idx = FT_Get_Char_Index(fcaches[i].face, rune))) {
-			*font = &fcaches[i];
-			return idx;
-		}
+	font_t *font;
+	FT_UInt idx;
+	int c;
+
+	if (bar.font.ascii)
+		return bar.font.ascii;
+
+	bar.font.ascii = malloc(128 * sizeof(int32_t));
+	nalloc++;
+	for (c = 0; c < 128; c++) {
+		/* control characters are not requested from fallback fonts */
+		idx = (c >= 0x20 && c < 0x7F) ? get_font(c, &font) : 0;
+		if (idx && font == &bar.font)
+			bar.font.ascii[c] = glyph_metrics_get(dc, font, idx)->x_advance;
+		else
+			bar.font.ascii[c] = -1;
 	}
+	return bar.font.ascii;
+}
 
-	/* find font when not found */
-	if (i >= nfcache) {
-		if (nfcache >= fcachecap) {
-			fcachecap += 8;
-			fcaches = realloc(fcaches, fcachecap * sizeof(font_t));
+/**
+ * title_truncate() - find the length of the title that fits in limits.
+ * @dc: draw context.
+ * @str: utf-8 string.
+ * @maxlen: max number of characters, 0 is unlimited.
+ * @maxwidth: max width in pixels, 0 is unlimited.
+ * @reserve: width reserved for the ellipsis on truncation.
+ * @truncated: (out) true if str does not fit.
+ *
+ * The string is scanned once until the limits are reached, so the cost does
+ * not depend on the length of long titles. ASCII is skipped by 8 bytes, and
+ * widths of skipped bytes are summed from advances of the primary font.
+ * Other widths are estimated by cached glyph advances without shaping.
+ *
+ * Return: byte length of str to draw.
+ */
+size_t
+title_truncate(draw_context_t *dc, const char *str, size_t maxlen, int maxwidth, int reserve, bool *truncated)
+{
+	const unsigned char *s = (const unsigned char *)str;
+	size_t i = 0, fit = 0, nchar = 0, n = strlen(str);
+	hb_position_t pen = 0, maxpen = (hb_position_t)maxwidth * 64, adv;
+	int32_t *ascii = NULL;
+	uint64_t word;
+	FcChar32 rune;
+	font_t *font;
+	FT_UInt idx;
+	int j, len;
+
+	*truncated = false;
+	while (i < n) {
+		if (maxlen && nchar >= maxlen)
+			goto TRUNCATE;
+
+		/* skip 8 ASCII characters at once */
+		if (i + 8 <= n && (!maxlen || nchar + 8 <= maxlen)) {
+			memcpy(&word, &s[i], sizeof(word));
+			if (!(word & 0x8080808080808080ULL)) {
+				if (maxwidth && !ascii)
+					ascii = ascii_advances(dc);
+				/* measured blocks are drawn or not, but may fill caches */
+				if (ascii)
+					FRAME_HASH(word ^ (word >> 32));
+				/* the block must fit with the ellipsis, or runes are measured */
+				for (j = 0, adv = 0; ascii && j < 8 && ascii[s[i + j]] >= 0; j++)
+					adv += ascii[s[i + j]];
+				if (!ascii || (j == 8 && pen + adv + reserve * 64 <= maxpen)) {
+					pen += adv;
+					i += 8;
+					nchar += 8;
+					fit = i;
+					continue;
+				}
+			}
 		}
 
-		pat = FcPatternDuplicate(bar.pattern);
-		charset = FcCharSetCreate();
-
-		/* find font that contains rune and scalable */
-		FcCharSetAddChar(charset, rune);
-		FcPatternAddCharSet(pat, FC_CHARSET, charset);
-		FcPatternAddBool(pat, FC_SCALABLE, 1);
-		FcPatternAddBool(pat, FC_COLOR, 1);
-
-		FcConfigSubstitute(NULL, pat, FcMatchPattern);
-		FcDefaultSubstitute(pat);
-
-		fonts = FcFontSort(NULL, pat, 1, NULL, &result);
-		FcPatternDestroy(pat);
-		FcCharSetDestroy(charset);
-		if (!fonts)
-			die("no fonts contain glyph: 0x%x\n", rune);
-
-		/* Allocate memory for the new cache entry. */
-		if (nfcache >= fcachecap) {
-			fcachecap += 16;
-			fcaches = realloc(fcaches, fcachecap * sizeof(font_t));
+		if (s[i] < 0x80) {
+			rune = s[i];
+			len = 1;
+		} else if ((len = FcUtf8ToUcs4(&s[i], &rune, n - i)) <= 0) {
+			rune = 0xFFFD;
+			len = 1;
 		}
 
-		/* veirfy matched font */
-		for (i = 0; i < fonts->nfont; i++) {
-			pat = fonts->fonts[i];
-			FcPatternGetString(pat, FC_FILE, 0, &path);
-			if (FT_New_Face(ftlib, (const char *)path, 0, &face))
-				die("FT_New_Face failed seeking fallback font: %s\n", path);
-			if ((idx = FT_Get_Char_Index(face, rune))) {
-				break;
-			}
-			FT_Done_Face(face);
-			face = NULL;
+		if (maxwidth) {
+			FRAME_HASH(rune);
+			idx = get_font(rune, &font);
+			pen += glyph_metrics_get(dc, font, idx)->x_advance;
+			if (pen > maxpen)
+				goto TRUNCATE;
+			if (pen + reserve * 64 > maxpen)
+				goto NEXT;
 		}
-		FcFontSetDestroy(fonts);
-		if (!face)
-			return 0;
-
-		fcaches[nfcache].face = face;
-		fcaches[nfcache].cairo = cairo_ft_font_face_create_for_ft_face(fcaches[nfcache].face, load_flag);
-		fcaches[nfcache].hb = hb_ft_font_create(face, NULL);
-
-		i = nfcache++;
+		fit = i + len;
+NEXT:
+		i += len;
+		nchar++;
 	}
-	*font = &fcaches[i];
+	return n;
 
-	return idx;
+TRUNCATE:
+	*truncated = true;
+	return fit;
 }
 
 /**
- * load_fonts() - load fonts by specified fontconfig pattern string.
- * @patstr: pattern string.
+ * coverage_count() - count entries of the coverage table by font.
  *
- * Return:
- * 0 - success
- * 1 - failure
+ * Return: allocated counts indexed by coverage_entry_t.font up to the last
+ *         fallback font.
  */
-bool
-load_fonts(const char *patstr)
+unsigned long *
+coverage_count()
 {
-	double dpi;
-	FcChar8 *path;
-	FcPattern *pat = FcNameParse((FcChar8 *)patstr);
-
-	if (!pat)
-		die("loadfonts(): failed parse pattern: %s\n", patstr);
-
-	/* get dpi and set to pattern */
-	dpi = (((double)bar.scr->height_in_pixels * 25.4) / (double)bar.scr->height_in_millimeters);
-	FcPatternAddDouble(pat, FC_DPI, dpi);
-	FcPatternAddBool(pat, FC_SCALABLE, 1);
-
-	FcConfigSubstitute(NULL, pat, FcMatchPattern);
-	FcDefaultSubstitute(pat);
-
-	FcResult result;
-	FcPattern *match = FcFontMatch(NULL, pat, &result);
-	if (!match) {
-		FcPatternDestroy(pat);
-		err("loadfonts(): no fonts match pattern: %s\n", patstr);
-		return false;
-	}
-
-	FcPatternGetString(match, FC_FILE, 0, &path);
-	if (FT_New_Face(ftlib, (const char *)path, 0, &bar.font.face))
-		die("FT_New_Face failed seeking fallback font: %s\n", path);
-	FcPatternGetDouble(match, FC_PIXEL_SIZE, 0, &bar.font_size);
-	FcPatternDestroy(match);
+	unsigned long *counts = calloc(nfcache + 2, sizeof(unsigned long));
+	size_t i, j;
 
-	if (!bar.font.face) {
-		FcPatternDestroy(pat);
-		err("loadfonts(): failed open font: %s\n", patstr);
-		return false;
+	for (i = 0; i < COVERAGE_NPAGE; i++) {
+		if (!coverage[i])
+			continue;
+		for (j = 0; j < COVERAGE_PAGE_SIZE; j++)
+			if (coverage[i][j].font < nfcache + 2)
+				counts[coverage[i][j].font]++;
 	}
-
-	bar.font.cairo = cairo_ft_font_face_create_for_ft_face(bar.font.face, load_flag);
-	bar.font.hb = hb_ft_font_create(bar.font.face, NULL);
-	bar.pattern = pat;
-
-	bar.font_opt = cairo_font_options_create();
-	cairo_font_options_set_antialias(bar.font_opt, CAIRO_ANTIALIAS_SUBPIXEL);
-	cairo_font_options_set_subpixel_order(bar.font_opt, CAIRO_SUBPIXEL_ORDER_RGB);
-	cairo_font_options_set_hint_style(bar.font_opt, CAIRO_HINT_STYLE_SLIGHT);
-	cairo_font_options_set_hint_metrics(bar.font_opt, CAIRO_HINT_METRICS_ON);
-
-	/* padding width */
-	celwidth = bar.font_size / 2 - 1;
-
-	graph_maxh = bar.font_size - (int)bar.font_size % 2;
-	graph_basey = (BAR_HEIGHT - graph_maxh) / 2;
-
-	return true;
+	return counts;
 }
 
 /**
- * get_base_line() - get text rendering baseline.
+ * coverage_get() - get the coverage table entry of the rune.
+ * @rune: FcChar32
  *
- * Return: y offset.
+ * Pages of the table are allocated on first access, so the table stays
+ * compact for scripts in use and sparse above the BMP.
+ *
+ * Return: coverage_entry_t * or NULL if rune is out of range.
  */
-int
-get_baseline()
+coverage_entry_t *
+coverage_get(FcChar32 rune)
 {
-	return (BAR_HEIGHT - bar.font_size / 2);
+	coverage_entry_t **page;
+
+	if (rune > 0x10FFFF)
+		return NULL;
+	page = &coverage[rune >> COVERAGE_PAGE_BITS];
+	if (!*page) {
+		*page = calloc(COVERAGE_PAGE_SIZE, sizeof(coverage_entry_t));
+		nalloc++;
+	}
+	return &(*page)[rune & (COVERAGE_PAGE_SIZE - 1)];
 }
 
 /**
- * dc_calc_render_pos() - calculate render position.
- * @dc: DC.
- * @glyphs: (in/out) XftCharFontSpec *.
- * @nglyph: lenght of glyphs.
+ * coverage_destroy() - free all pages of the coverage table.
  */
 void
-dc_calc_render_pos(draw_context_t *dc, glyph_font_spec_t *glyphs, int nglyph)
+coverage_destroy()
 {
-	int x = dc_get_x(dc);
-	for (int i = 0; i < nglyph; i++) {
-		glyphs[i].glyph.x += x;
+	int i;
+	for (i = 0; i < COVERAGE_NPAGE; i++) {
+		free(coverage[i]);
+		coverage[i] = NULL;
 	}
 }
 
 /**
- * load_glyphs_from_hb_buffer() - load glyphs from hb_buffer_t.
- * @dc: draw context.
- * @buffer: harfbuzz buffer.
- * @font: a font for rendering.
- * @x: (out) base x position.
- * @y: base y position.
- * @glyphs: (out) loaded glyphs.
- * @len: max length of glyphs.
- *
- * Return: size_t
- *   num of loaded glyphs.
+ * coverage_invalidate() - forget runes resolved to the font.
+ * @font: font index of the coverage table entries.
  */
-size_t
-load_glyphs_from_hb_buffer(draw_context_t *dc, hb_buffer_t *buffer, font_t *font, int *x, int y, glyph_font_spec_t *glyphs, size_t len)
+void
+coverage_invalidate(uint16_t font)
 {
-	cairo_text_extents_t extents;
-	hb_glyph_info_t *infos;
-	hb_glyph_position_t *pos;
-	uint32_t i = 0, ninfo = 0, npos = 0;
+	int i, j;
 
-	cairo_set_font_face(dc->cr, font->cairo);
-	hb_buffer_guess_segment_properties(buffer);
-	hb_shape(font->hb, buffer, NULL, 0);
-	infos = hb_buffer_get_glyph_infos(buffer, &ninfo);
-	pos = hb_buffer_get_glyph_positions(buffer, &npos);
+	for (i = 0; i < COVERAGE_NPAGE; i++) {
+		if (!coverage[i])
+			continue;
+		for (j = 0; j < COVERAGE_PAGE_SIZE; j++)
+			if (coverage[i][j].font == font)
+				coverage[i][j].font = COVERAGE_UNKNOWN;
+	}
+}
 
-	for (i = 0; i < ninfo && i < len; i++) {
-		glyphs[i].font = font;
-		glyphs[i].glyph.index = infos[i].codepoint;
-		glyphs[i].glyph.x = *x;
-		glyphs[i].glyph.y = y;
+/**
+ * coverage_set() - record the resolved font of the coverage table entry.
+ * @entry: coverage_entry_t
+ * @font: the font contains the rune.
+ * @idx: glyph index in font.
+ */
+void
+coverage_set(coverage_entry_t *entry, font_t *font, FT_UInt idx)
+{
+	int i;
 
-		if (pos[i].x_advance) {
-			*x += pos[i].x_advance / 64;
-		} else {
-			cairo_glyph_extents(dc->cr, &glyphs[i].glyph, 1, &extents);
-			*x += extents.x_advance;
+	if (font == &bar.font) {
+		entry->font = COVERAGE_PRIMARY;
+	} else {
+		for (i = 0; i < nfcache; i++)
+			if (fcaches[i] == font)
+				entry->font = i + 2;
+	}
+	entry->glyph = idx;
+}
+
+/**
+ * rune_missing() - check no font contains the rune.
+ * @rune: FcChar32
+ *
+ * Runes known to be missing are drawn with the primary font for good, so
+ * runs containing them need not be shaped again.
+ *
+ * Return: bool
+ */
+bool
+rune_missing(FcChar32 rune)
+{
+	coverage_entry_t *entry = coverage_get(rune);
+
+	return !entry || entry->font == COVERAGE_MISSING;
+}
+
+/**
+ * get_font() - finds a font that renderable specified rune.
+ * @rune: FcChar32
+ * @font: (out) font that contains rune.
+ *
+ * Resolved runes are recorded in the coverage table, so repeated lookups
+ * does not touch FreeType. A rune not covered by loaded fonts is resolved
+ * by the font worker, and the primary font is used until it is resolved.
+ *
+ * Return: glyph index or 0 if no font contains rune.
+ */
+FT_UInt
+get_font(FcChar32 rune, font_t **font)
+{
+	coverage_entry_t *entry;
+	const char *path;
+	FT_UInt idx;
+	int index = 0;
+
+	*font = &bar.font;
+	if (!(entry = coverage_get(rune)))
+		return 0;
+
+	switch (entry->font) {
+	case COVERAGE_UNKNOWN:
+		break;
+	case COVERAGE_PENDING:
+		font_worker_wait(rune);
+		return 0;
+	case COVERAGE_MISSING:
+		return 0;
+	case COVERAGE_PRIMARY:
+		return entry->glyph;
+	default:
+		*font = fcaches[entry->font - 2];
+		(*font)->used = nframe;
+		return entry->glyph;
+	}
+
+	if ((idx = find_font(rune, font))) {
+		coverage_set(entry, *font, idx);
+		return idx;
+	}
+
+	/* the worker loads the font file of the persistent cache unless loaded */
+	if (!fontcache_lookup(bar.fontcache, rune, &path, &index) || font_cache_find(path, index))
+		path = NULL;
+	/* resolve in background and draw with the primary font until then */
+	if (font_worker_request(rune, path, index))
+		entry->font = COVERAGE_PENDING;
+	*font = &bar.font;
+	return 0;
+}
+
+/**
+ * fallback_fonts() - get fallback fonts sorted for the base pattern.
+ *
+ * The sorted set and charsets of each font are computed once on first call,
+ * so the persistent font cache can resolve runes without fontconfig.
+ * The function must be called from the font worker only.
+ *
+ * Return: FcFontSet * or NULL.
+ */
+FcFontSet *
+fallback_fonts()
+{
+	FcResult result;
+	FcPattern *pat;
+	int i;
+
+	if (bar.set)
+		return bar.set;
+
+	pat = FcPatternDuplicate(bar.pattern);
+	FcPatternAddBool(pat, FC_SCALABLE, 1);
+	FcPatternAddBool(pat, FC_COLOR, 1);
+
+	FcConfigSubstitute(NULL, pat, FcMatchPattern);
+	FcDefaultSubstitute(pat);
+
+	bar.set = FcFontSort(NULL, pat, 1, NULL, &result);
+	FcPatternDestroy(pat);
+	if (!bar.set)
+		return NULL;
+
+	bar.fallbacks = calloc(bar.set->nfont, sizeof(fallback_t));
+	for (i = 0; i < bar.set->nfont; i++) {
+		bar.fallbacks[i].pattern = bar.set->fonts[i];
+		if (FcPatternGetCharSet(bar.set->fonts[i], FC_CHARSET, 0, &bar.fallbacks[i].charset) != FcResultMatch)
+			bar.fallbacks[i].charset = NULL;
+	}
+	return bar.set;
+}
+
+/**
+ * fallback_lookup() - find the fallback font file that contains the rune.
+ * @rune: FcChar32
+ * @path: (out) allocated path of the font file.
+ * @index: (out) face index in the font file.
+ *
+ * The function is called from the font worker.
+ *
+ * Return: bool
+ */
+bool
+fallback_lookup(FcChar32 rune, char **path, int *index)
+{
+	FcFontSet *fonts;
+	fallback_t *fallback;
+	FcChar8 *file;
+	int i;
+
+	if (!(fonts = fallback_fonts()))
+		return false;
+
+	for (i = 0; i < fonts->nfont; i++) {
+		fallback = &bar.fallbacks[i];
+		if (!fallback->charset || !FcCharSetHasChar(fallback->charset, rune))
+			continue;
+		if (FcPatternGetString(fallback->pattern, FC_FILE, 0, &file) != FcResultMatch)
+			continue;
+		if (FcPatternGetInteger(fallback->pattern, FC_INDEX, 0, index) != FcResultMatch)
+			*index = 0;
+		*path = strdup((const char *)file);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * font_worker_start() - start the font worker.
+ *
+ * The worker is started by the event thread before the render thread,
+ * which requests runes to it.
+ *
+ * Return: bool
+ */
+bool
+font_worker_start()
+{
+	font_worker_t *w = &fworker;
+
+	if (w->running)
+		return true;
+	if (pipe(w->pipe))
+		return false;
+	fcntl(w->pipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(w->pipe[1], F_SETFL, O_NONBLOCK);
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_cond_init(&w->cond, NULL);
+	w->running = true;
+	if (pthread_create(&w->thread, NULL, font_worker_run, w)) {
+		err("pthread_create(): failed to start font worker\n");
+		w->running = false;
+		close(w->pipe[0]);
+		close(w->pipe[1]);
+		return false;
+	}
+	w->pollfd.fd = w->pipe[0];
+	w->pollfd.deinit = font_worker_stop;
+	w->pollfd.handler = font_worker_handle;
+	w->pollfd.name = "fonts";
+	poll_add(&w->pollfd);
+	return true;
+}
+
+/**
+ * font_waiter_add() - record the label being drawn as waiting for the rune.
+ * @w: font_worker_t locked by the caller.
+ * @rune: FcChar32
+ * @done: the rune has been resolved already.
+ *
+ * The whole frame is rendered for runes requested out of labels and when
+ * the waiters do not fit in the tables.
+ *
+ * Return: false if the rune has waiters already.
+ */
+bool
+font_waiter_add(font_worker_t *w, FcChar32 rune, bool done)
+{
+	font_waiter_t *waiter = NULL;
+	bool added = false;
+	int i;
+
+	for (i = 0; i < w->nwaiter && !waiter; i++)
+		if (w->waiters[i].rune == rune)
+			waiter = &w->waiters[i];
+	if (!waiter && w->nwaiter >= FONT_QUEUE_SIZE) {
+		w->full = true;
+		return true;
+	}
+	if (!waiter) {
+		waiter = &w->waiters[w->nwaiter++];
+		waiter->rune = rune;
+		waiter->nopt = 0;
+		waiter->done = done;
+		added = true;
+	}
+
+	if (!draw_option) {
+		waiter->nopt = FONT_WAITERS + 1;
+		return added;
+	}
+	for (i = 0; i < waiter->nopt && i < FONT_WAITERS; i++)
+		if (waiter->opts[i] == draw_option)
+			return added;
+	if (waiter->nopt < FONT_WAITERS)
+		waiter->opts[waiter->nopt++] = draw_option;
+	else
+		waiter->nopt = FONT_WAITERS + 1;
+	return added;
+}
+
+/**
+ * font_worker_request() - request resolution of the rune to the font worker.
+ * @rune: FcChar32
+ * @path: font file found by the persistent font cache or NULL.
+ * @index: face index in the font file.
+ *
+ * The label being drawn is rendered again when the rune is resolved.
+ *
+ * Return: false if the worker is not running or the queue is full.
+ */
+bool
+font_worker_request(FcChar32 rune, const char *path, int index)
+{
+	font_worker_t *w = &fworker;
+	font_request_t *req;
+
+	if (!w->running)
+		return false;
+
+	pthread_mutex_lock(&w->lock);
+	if (w->noutstanding >= FONT_QUEUE_SIZE) {
+		pthread_mutex_unlock(&w->lock);
+		return false;
+	}
+	req = &w->requests[(w->head + w->nrune++) % FONT_QUEUE_SIZE];
+	req->rune = rune;
+	req->path = path ? strdup(path) : NULL;
+	req->index = index;
+	w->noutstanding++;
+	font_waiter_add(w, rune, false);
+	pthread_cond_signal(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+
+	return true;
+}
+
+/**
+ * font_worker_wait() - render the label being drawn when the rune is resolved.
+ * @rune: FcChar32 pending on the font worker.
+ *
+ * Waiters of the rune may have been handled already while the result is
+ * not installed yet, then the worker is woken to handle the label again.
+ */
+void
+font_worker_wait(FcChar32 rune)
+{
+	font_worker_t *w = &fworker;
+
+	pthread_mutex_lock(&w->lock);
+	if (font_waiter_add(w, rune, true))
+		(void)!write(w->pipe[1], "", 1);
+	pthread_mutex_unlock(&w->lock);
+}
+
+/**
+ * font_open() - open a fallback font that contains the rune.
+ * @w: font_worker_t
+ * @path: font file.
+ * @index: face index in the font file.
+ * @rune: FcChar32
+ * @glyph: (out) glyph index of rune.
+ *
+ * Fonts loaded for results not installed yet are shared. The function must
+ * be called from the font worker only.
+ *
+ * Return: font_t * or NULL if the font can not be loaded or lacks rune.
+ */
+font_t *
+font_open(font_worker_t *w, const char *path, int index, FcChar32 rune, FT_UInt *glyph)
+{
+	font_t *font;
+	FT_Face face;
+	FT_Error error;
+	int i;
+
+	/* results are not touched by the render thread until installed */
+	pthread_mutex_lock(&w->lock);
+	for (i = 0; i < w->nresult; i++) {
+		font = w->results[i].font;
+		if (font && font->index == index && !strcmp(font->path, path)) {
+			*glyph = FT_Get_Char_Index(font->face, rune);
+			pthread_mutex_unlock(&w->lock);
+			return *glyph ? font : NULL;
 		}
 	}
-	return i;
+	pthread_mutex_unlock(&w->lock);
+
+	pthread_mutex_lock(&ftlock);
+	error = FT_New_Face(ftlib, path, index, &face);
+	pthread_mutex_unlock(&ftlock);
+	if (error) {
+		err("FT_New_Face failed loading fallback font: %s\n", path);
+		return NULL;
+	}
+	if (!(*glyph = FT_Get_Char_Index(face, rune))) {
+		pthread_mutex_lock(&ftlock);
+		FT_Done_Face(face);
+		pthread_mutex_unlock(&ftlock);
+		return NULL;
+	}
+	return font_new(face, path, index);
 }
 
 /**
- * load_glyphs() - load XGlyphFontSpec from specified str.
- * @dc: draw context.
- * @str: utf-8 string.
- * @glyphs: (out) XCharFontSpec *.
- * @nglyph: length of glyphs.
- * @width: (out) rendering width.
+ * font_worker_load() - load the fallback font of the requested rune.
+ * @w: font_worker_t
+ * @req: font_request_t
+ * @res: (out) font_result_t
  *
- * Return: number of loaded glyphs.
+ * The font file found by the persistent font cache is tried before
+ * fontconfig. The face and its cairo and harfbuzz fonts are created here,
+ * so the render thread only installs them.
  */
-int
-load_glyphs(draw_context_t *dc, const char *str, glyph_font_spec_t *glyphs, int nglyph, int *width)
+void
+font_worker_load(font_worker_t *w, const font_request_t *req, font_result_t *res)
 {
-	FcChar32 rune = 0;
-	int i, y, len = 0;
-	size_t offset = 0, num = 0;
-	font_t *font = NULL, *prev = NULL;
-	hb_buffer_t *buffer = NULL;
+	char *path;
+	int index;
 
-	buffer = hb_buffer_create();
+	res->rune = req->rune;
+	res->record = false;
+	res->glyph = 0;
+	if (req->path && (res->font = font_open(w, req->path, req->index, req->rune, &res->glyph)))
+		return;
 
-	y = get_baseline();
-	*width = 0;
-	for (i = 0; offset < strlen(str) && i < nglyph; i++, offset += len) {
-		len = FcUtf8ToUcs4((FcChar8 *)&str[offset], &rune, strlen(str) - offset);
-		if (get_font(rune, &font) && prev && prev != font) {
-			num += load_glyphs_from_hb_buffer(dc, buffer, prev, width, y, &glyphs[num], nglyph - num);
-			hb_buffer_clear_contents(buffer);
+	res->font = NULL;
+	if (!fallback_lookup(req->rune, &path, &index))
+		return;
+	res->font = font_open(w, path, index, req->rune, &res->glyph);
+	res->record = !!res->font;
+	free(path);
+}
+
+/**
+ * font_worker_run() - main loop of the font worker.
+ * @arg: font_worker_t *
+ *
+ * Return: NULL
+ */
+void *
+font_worker_run(void *arg)
+{
+	font_worker_t *w = arg;
+	font_request_t req;
+	font_result_t res;
+	int i;
+
+	pthread_mutex_lock(&w->lock);
+	while (w->running) {
+		if (!w->nrune) {
+			pthread_cond_wait(&w->cond, &w->lock);
+			continue;
 		}
-		prev = font;
-		hb_buffer_add_codepoints(buffer, &rune, 1, 0, 1);
+		req = w->requests[w->head];
+		w->head = (w->head + 1) % FONT_QUEUE_SIZE;
+		w->nrune--;
+		pthread_mutex_unlock(&w->lock);
+
+		font_worker_load(w, &req, &res);
+		free(req.path);
+
+		pthread_mutex_lock(&w->lock);
+		w->results[w->nresult++] = res;
+		for (i = 0; i < w->nwaiter; i++)
+			if (w->waiters[i].rune == res.rune)
+				w->waiters[i].done = true;
+		(void)!write(w->pipe[1], "", 1);
 	}
-	if (prev && hb_buffer_get_length(buffer))
-		num += load_glyphs_from_hb_buffer(dc, buffer, font, width, y, &glyphs[num], nglyph - num);
+	pthread_mutex_unlock(&w->lock);
 
-	hb_buffer_destroy(buffer);
+	return NULL;
+}
 
-	return num;
+/**
+ * font_worker_handle() - PollUpdateHandler for the font worker.
+ * @fd: read end of the pipe.
+ *
+ * Results are installed by the render thread on the next frame, which
+ * renders only the labels waiting for the resolved runes.
+ *
+ * Return: poll_result_t
+ *
+ * waiters out of labels or the tables - PR_UPDATE
+ * otherwise                            - PR_NOOP
+ */
+poll_result_t
+font_worker_handle(int fd)
+{
+	font_worker_t *w = &fworker;
+	module_option_t *opts[FONT_QUEUE_SIZE * FONT_WAITERS];
+	font_waiter_t *waiter;
+	char tmp[FONT_QUEUE_SIZE];
+	ssize_t len;
+	bool full;
+	int i, j, nopt = 0, nwaiter = 0;
+
+	/* a byte is written for each result and late waiter */
+	while ((len = read(fd, tmp, sizeof(tmp))) > 0)
+		w->pollfd.nevent += len;
+
+	pthread_mutex_lock(&w->lock);
+	full = w->full;
+	w->full = false;
+	for (i = 0; i < w->nwaiter; i++) {
+		waiter = &w->waiters[i];
+		if (!waiter->done) {
+			w->waiters[nwaiter++] = *waiter;
+			continue;
+		}
+		if (waiter->nopt > FONT_WAITERS)
+			full = true;
+		for (j = 0; j < waiter->nopt && j < FONT_WAITERS; j++)
+			opts[nopt++] = waiter->opts[j];
+	}
+	w->nwaiter = nwaiter;
+	pthread_mutex_unlock(&w->lock);
+
+	if (full)
+		return PR_UPDATE;
+	for (i = 0; i < nopt; i++)
+		render_request(opts[i]);
+	return PR_NOOP;
 }
 
 /**
- * draw_padding_em() - render padding by em units.
- * @dc: DC.
- * @num: padding width.
+ * font_worker_apply() - install fonts resolved by the font worker.
+ *
+ * Font caches and the coverage table are owned by the render thread, so
+ * this is called at the start of frames.
  */
 void
-draw_padding_em(draw_context_t *dc, double em)
+font_worker_apply()
 {
-	draw_padding(dc, celwidth * em);
+	font_worker_t *w = &fworker;
+	font_result_t results[FONT_QUEUE_SIZE];
+	coverage_entry_t *entry;
+	font_t *font, *cached;
+	int i, j, n;
+
+	if (!w->running)
+		return;
+
+	pthread_mutex_lock(&w->lock);
+	n = w->nresult;
+	memcpy(results, w->results, n * sizeof(font_result_t));
+	w->nresult = 0;
+	w->noutstanding -= n;
+	pthread_mutex_unlock(&w->lock);
+
+	for (i = 0; i < n; i++) {
+		entry = coverage_get(results[i].rune);
+		entry->font = COVERAGE_MISSING;
+		if (!(font = results[i].font))
+			continue;
+
+		if (!(cached = font_cache_find(font->path, font->index))) {
+			cached = font_cache_add(font);
+		} else if (cached != font) {
+			/* loaded again while the font is installed */
+			for (j = i + 1; j < n; j++)
+				if (results[j].font == font)
+					results[j].font = cached;
+			font_destroy(*font);
+			free(font);
+		}
+		if (results[i].record)
+			fontcache_add(bar.fontcache, results[i].rune, cached->path, cached->index);
+		coverage_set(entry, cached, results[i].glyph);
+	}
+}
+
+/**
+ * font_worker_stop() - stop the font worker and release its resources.
+ *
+ * Return: 0
+ */
+int
+font_worker_stop()
+{
+	font_worker_t *w = &fworker;
+	font_t *font;
+	int i, j;
+
+	if (!w->running)
+		return 0;
+
+	pthread_mutex_lock(&w->lock);
+	w->running = false;
+	pthread_cond_signal(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+	pthread_join(w->thread, NULL);
+
+	for (i = 0; i < w->nrune; i++)
+		free(w->requests[(w->head + i) % FONT_QUEUE_SIZE].path);
+	for (i = 0; i < w->nresult; i++) {
+		if (!(font = w->results[i].font))
+			continue;
+		/* results of the same font share it */
+		for (j = i + 1; j < w->nresult; j++)
+			if (w->results[j].font == font)
+				w->results[j].font = NULL;
+		font_destroy(*font);
+		free(font);
+	}
+	close(w->pipe[0]);
+	close(w->pipe[1]);
+	pthread_cond_destroy(&w->cond);
+	pthread_mutex_destroy(&w->lock);
+	return 0;
+}
+
+/**
+ * find_font() - finds a loaded font that renderable specified rune.
+ * @rune: FcChar32
+ * @font: (out) font that contains rune.
+ *
+ * The function looks up the primary font and font caches only, fonts are
+ * loaded by the font worker.
+ *
+ * Return: glyph index or 0 if no loaded font contains rune.
+ */
+FT_UInt
+find_font(FcChar32 rune, font_t **font)
+{
+	int i, idx;
+
+	/* Lookup character index with default font. */
+	if ((idx = FT_Get_Char_Index(bar.font.face, rune))) {
+		*font = &bar.font;
+		return idx;
+	}
+
+	/* fallback on font cache */
+	for (i = 0; i < nfcache; i++) {
+		if ((idx = FT_Get_Char_Index(fcaches[i]->face, rune))) {
+			*font = fcaches[i];
+			(*font)->used = nframe;
+			return idx;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * font_cache_find() - find a loaded fallback font by its file.
+ * @path: font file.
+ * @index: face index in the font file.
+ *
+ * Return: font_t * or NULL.
+ */
+font_t *
+font_cache_find(const char *path, int index)
+{
+	int i;
+	for (i = 0; i < nfcache; i++)
+		if (fcaches[i]->index == index && !strcmp(fcaches[i]->path, path))
+			return fcaches[i];
+	return NULL;
+}
+
+/**
+ * font_cache_evict() - unload the least recently used fallback font.
+ *
+ * Fonts used in the current frame or by text runs are never evicted,
+ * because glyphs still refer them. Runes and glyph runs resolved to the evicted
+ * font are dropped from the coverage table and the glyph run cache.
+ *
+ * Return: index of the freed slot in fcaches or -1 if nothing is evictable.
+ */
+int
+font_cache_evict()
+{
+	font_t *font;
+	int i, lru = -1;
+
+	for (i = 0; i < nfcache; i++) {
+		if (fcaches[i]->used >= nframe || fcaches[i]->npin)
+			continue;
+		if (lru < 0 || fcaches[i]->used < fcaches[lru]->used)
+			lru = i;
+	}
+	if (lru < 0)
+		return -1;
+
+	font = fcaches[lru];
+	coverage_invalidate(lru + 2);
+	glyph_run_invalidate(font);
+	font_destroy(*font);
+	free(font);
+	fcaches[lru] = NULL;
+	nfevict++;
+
+	return lru;
+}
+
+/**
+ * font_new() - create a fallback font of the loaded face.
+ * @face: loaded face.
+ * @path: font file of face.
+ * @index: face index in the font file.
+ *
+ * Return: font_t *
+ */
+font_t *
+font_new(FT_Face face, const char *path, int index)
+{
+	font_t *font = calloc(1, sizeof(font_t));
+
+	font->face = face;
+	font->cairo = cairo_ft_font_face_create_for_ft_face(face, load_flag);
+	font->hb = hb_ft_font_create(face, NULL);
+	font->path = strdup(path);
+	font->index = index;
+	return font;
+}
+
+/**
+ * font_cache_add() - add a fallback font to font caches.
+ * @font: font created by font_new().
+ *
+ * The least recently used font is evicted if the number of fonts reaches
+ * FONT_CACHE_SIZE.
+ *
+ * Return: font
+ */
+font_t *
+font_cache_add(font_t *font)
+{
+	int slot = -1;
+
+	/* logged once, later overruns are counted in statistics */
+	if (nfcache >= FONT_CACHE_SIZE && (slot = font_cache_evict()) < 0 && !nfoverrun++)
+		err("font_cache_add(): all %d fonts are in use, growing past FONT_CACHE_SIZE\n",
+		    nfcache);
+	if (slot < 0 && nfcache >= fcachecap) {
+		fcachecap += 8;
+		fcaches = realloc(fcaches, fcachecap * sizeof(font_t *));
+	}
+
+	font->used = nframe;
+
+	if (slot < 0)
+		slot = nfcache++;
+	return fcaches[slot] = font;
+}
+
+/**
+ * load_fonts() - load fonts by specified fontconfig pattern string.
+ * @patstr: pattern string.
+ *
+ * Return:
+ * 0 - success
+ * 1 - failure
+ */
+bool
+load_fonts(const char *patstr)
+{
+	double dpi;
+	FcChar8 *path, *patname;
+	FcPattern *pat = FcNameParse((FcChar8 *)patstr);
+
+	if (!pat)
+		die("loadfonts(): failed parse pattern: %s\n", patstr);
+
+	/* get dpi and set to pattern */
+	dpi = (((double)bar.scr->height_in_pixels * 25.4) / (double)bar.scr->height_in_millimeters);
+	FcPatternAddDouble(pat, FC_DPI, dpi);
+	FcPatternAddBool(pat, FC_SCALABLE, 1);
+
+	FcConfigSubstitute(NULL, pat, FcMatchPattern);
+	FcDefaultSubstitute(pat);
+
+	FcResult result;
+	FcPattern *match = FcFontMatch(NULL, pat, &result);
+	if (!match) {
+		FcPatternDestroy(pat);
+		err("loadfonts(): no fonts match pattern: %s\n", patstr);
+		return false;
+	}
+
+	FcPatternGetString(match, FC_FILE, 0, &path);
+	if (FT_New_Face(ftlib, (const char *)path, 0, &bar.font.face))
+		die("FT_New_Face failed seeking fallback font: %s\n", path);
+	FcPatternGetDouble(match, FC_PIXEL_SIZE, 0, &bar.font_size);
+	FcPatternDestroy(match);
+
+	if (!bar.font.face) {
+		FcPatternDestroy(pat);
+		err("loadfonts(): failed open font: %s\n", patstr);
+		return false;
+	}
+
+	bar.font.cairo = cairo_ft_font_face_create_for_ft_face(bar.font.face, load_flag);
+	bar.font.hb = hb_ft_font_create(bar.font.face, NULL);
+	bar.pattern = pat;
+
+	/* persistent cache of fallback fonts for the pattern */
+	if ((patname = FcNameUnparse(pat))) {
+		bar.fontcache = fontcache_new((const char *)patname);
+		FcStrFree(patname);
+	} else {
+		bar.fontcache = fontcache_new(patstr);
+	}
+
+	bar.font_opt = cairo_font_options_create();
+	cairo_font_options_set_antialias(bar.font_opt, CAIRO_ANTIALIAS_SUBPIXEL);
+	cairo_font_options_set_subpixel_order(bar.font_opt, CAIRO_SUBPIXEL_ORDER_RGB);
+	cairo_font_options_set_hint_style(bar.font_opt, CAIRO_HINT_STYLE_SLIGHT);
+	cairo_font_options_set_hint_metrics(bar.font_opt, CAIRO_HINT_METRICS_ON);
+
+	/* padding width */
+	celwidth = bar.font_size / 2 - 1;
+
+	graph_maxh = bar.font_size - (int)bar.font_size % 2;
+	graph_basey = (BAR_HEIGHT - graph_maxh) / 2;
+
+	glyph_run_cache_init();
+	shape_buffer = hb_buffer_create();
+
+	return true;
+}
+
+/**
+ * get_base_line() - get text rendering baseline.
+ *
+ * Return: y offset.
+ */
+int
+get_baseline()
+{
+	return (BAR_HEIGHT - bar.font_size / 2);
+}
+
+/**
+ * dc_calc_render_pos() - calculate render position.
+ * @dc: DC.
+ * @glyphs: (in/out) XftCharFontSpec *.
+ * @nglyph: lenght of glyphs.
+ */
+void
+dc_calc_render_pos(draw_context_t *dc, glyph_font_spec_t *glyphs, int nglyph)
+{
+	int x = dc_get_x(dc);
+	for (int i = 0; i < nglyph; i++) {
+		glyphs[i].glyph.x += x;
+	}
+}
+
+/**
+ * glyph_metrics_get() - get metrics of the glyph from the cache of the font.
+ * @dc: draw context.
+ * @font: font_t
+ * @glyph: glyph index.
+ *
+ * A glyph is measured by cairo with the font size and options used by
+ * draw_glyphs() only once, and shared by all labels that use the font.
+ *
+ * Return: glyph_metrics_t *
+ */
+glyph_metrics_t *
+glyph_metrics_get(draw_context_t *dc, font_t *font, FT_UInt glyph)
+{
+	glyph_metrics_t *old = font->metrics, *m;
+	cairo_text_extents_t extents;
+	cairo_glyph_t cglyph = { 0 };
+	size_t i, oldcap = font->metriccap;
+
+	if (font->metrics) {
+		for (i = glyph; ; i++) {
+			m = &font->metrics[i & (font->metriccap - 1)];
+			if (!m->glyph)
+				break;
+			if (m->glyph == glyph + 1)
+				return m;
+		}
+	}
+
+	/* keep load factor under 1/2 */
+	if ((font->nmetric + 1) * 2 > font->metriccap) {
+		font->metriccap = oldcap ? oldcap * 2 : METRICS_CACHE_SIZE;
+		font->metrics = calloc(font->metriccap, sizeof(glyph_metrics_t));
+		nalloc++;
+		for (i = 0; i < oldcap; i++) {
+			if (!old[i].glyph)
+				continue;
+			for (m = &font->metrics[(old[i].glyph - 1) & (font->metriccap - 1)]; m->glyph;)
+				m = (m == &font->metrics[font->metriccap - 1]) ? font->metrics : m + 1;
+			*m = old[i];
+		}
+		free(old);
+	}
+	for (i = glyph; font->metrics[i & (font->metriccap - 1)].glyph; i++)
+		;
+	m = &font->metrics[i & (font->metriccap - 1)];
+
+	cglyph.index = glyph;
+	cairo_set_font_face(dc->cr, font->cairo);
+	cairo_set_font_options(dc->cr, bar.font_opt);
+	cairo_set_font_size(dc->cr, bar.font_size);
+	cairo_glyph_extents(dc->cr, &cglyph, 1, &extents);
+
+	m->glyph = glyph + 1;
+	m->x_advance = TO_26_6(extents.x_advance);
+	m->x_bearing = TO_26_6(extents.x_bearing);
+	m->y_bearing = TO_26_6(extents.y_bearing);
+	m->width = TO_26_6(extents.width);
+	m->height = TO_26_6(extents.height);
+	font->nmetric++;
+
+	return m;
+}
+
+/**
+ * glyph_raster_get() - get the rasterized surface of the color glyph.
+ * @dc: draw context.
+ * @font: font_t that has color glyphs.
+ * @glyph: glyph index.
+ *
+ * Glyphs loaded as BGRA bitmaps (CBDT, sbix) are rasterized once into an
+ * ARGB surface similar to the target of dc, i.e. a server side pixmap for
+ * the xcb backend, and composited on later draws without scaling the
+ * bitmap. Outlines and COLR layers of the font are drawn in the color of
+ * the label, so m->bitmap is false for them.
+ *
+ * Return: glyph_metrics_t * that has the raster.
+ */
+glyph_metrics_t *
+glyph_raster_get(draw_context_t *dc, font_t *font, FT_UInt glyph)
+{
+	glyph_metrics_t *m = glyph_metrics_get(dc, font, glyph);
+	cairo_glyph_t cglyph = { 0 };
+	cairo_scaled_font_t *scaled;
+	FT_Face face;
+	cairo_t *cr;
+	int w, h;
+
+	if (m->rastered)
+		return m;
+	m->rastered = true;
+
+	/* the face is sized by cairo while it is locked */
+	cairo_set_font_face(dc->cr, font->cairo);
+	cairo_set_font_options(dc->cr, bar.font_opt);
+	cairo_set_font_size(dc->cr, bar.font_size);
+	scaled = cairo_get_scaled_font(dc->cr);
+	if (!(face = cairo_ft_scaled_font_lock_face(scaled)))
+		return m;
+	m->bitmap = !FT_Load_Glyph(face, glyph, FT_LOAD_COLOR) &&
+	            face->glyph->format == FT_GLYPH_FORMAT_BITMAP &&
+	            face->glyph->bitmap.pixel_mode == FT_PIXEL_MODE_BGRA;
+	cairo_ft_scaled_font_unlock_face(scaled);
+	if (!m->bitmap)
+		return m;
+
+	m->raster_x = FLOOR_26_6(m->x_bearing);
+	m->raster_y = FLOOR_26_6(m->y_bearing);
+	w = CEIL_26_6(m->x_bearing + m->width) - m->raster_x;
+	h = CEIL_26_6(m->y_bearing + m->height) - m->raster_y;
+	if (w <= 0 || h <= 0)
+		return m;
+	m->raster_w = w;
+	m->raster_h = h;
+
+	m->raster = cairo_surface_create_similar(cairo_get_target(dc->cr), CAIRO_CONTENT_COLOR_ALPHA, w, h);
+	cr = cairo_create(m->raster);
+	cairo_set_font_face(cr, font->cairo);
+	cairo_set_font_options(cr, bar.font_opt);
+	cairo_set_font_size(cr, bar.font_size);
+	cglyph.index = glyph;
+	cglyph.x = -m->raster_x;
+	cglyph.y = -m->raster_y;
+	cairo_show_glyphs(cr, &cglyph, 1);
+	cairo_destroy(cr);
+	nraster++;
+
+	return m;
+}
+
+/**
+ * font_cache_bytes() - get bytes of glyph caches of the font.
+ * @font: font_t
+ *
+ * Metrics, rasters of color glyphs and glyph tables of the font are
+ * counted. Rasters are counted as ARGB32 pixels wherever they are stored.
+ *
+ * Return: bytes
+ */
+size_t
+font_cache_bytes(const font_t *font)
+{
+	size_t i, size = font->metriccap * sizeof(glyph_metrics_t);
+
+	for (i = 0; i < font->metriccap; i++)
+		if (font->metrics[i].raster)
+			size += (size_t)font->metrics[i].raster_w * font->metrics[i].raster_h * 4;
+	if (font->numerics)
+		size += 128 * sizeof(numeric_glyph_t);
+	if (font->ascii)
+		size += 128 * sizeof(int32_t);
+	return size;
+}
+
+/**
+ * glyph_metrics_destroy() - free the glyph metrics cache of the font.
+ * @font: font_t
+ */
+void
+glyph_metrics_destroy(font_t *font)
+{
+	size_t i;
+
+	for (i = 0; i < font->metriccap; i++) {
+		if (font->metrics[i].raster) {
+			cairo_surface_destroy(font->metrics[i].raster);
+			nraster--;
+		}
+	}
+	free(font->metrics);
+}
+
+/**
+ * load_glyphs_from_hb_buffer() - load glyphs from hb_buffer_t.
+ * @dc: draw context.
+ * @buffer: harfbuzz buffer.
+ * @font: a font for rendering.
+ * @pen: (in/out) pen position in 26.6 fixed point.
+ * @y: base y position.
+ * @glyphs: (out) loaded glyphs.
+ * @len: max length of glyphs.
+ *
+ * Return: size_t
+ *   num of loaded glyphs.
+ */
+size_t
+load_glyphs_from_hb_buffer(draw_context_t *dc, hb_buffer_t *buffer, font_t *font, hb_position_t *pen, int y, glyph_font_spec_t *glyphs, size_t len)
+{
+	hb_glyph_info_t *infos;
+	hb_glyph_position_t *pos;
+	uint32_t i = 0, ninfo = 0, npos = 0;
+
+	hb_buffer_guess_segment_properties(buffer);
+	hb_shape(font->hb, buffer, NULL, 0);
+	infos = hb_buffer_get_glyph_infos(buffer, &ninfo);
+	pos = hb_buffer_get_glyph_positions(buffer, &npos);
+
+	for (i = 0; i < ninfo && i < len; i++) {
+		glyphs[i].font = font;
+		glyphs[i].glyph.index = infos[i].codepoint;
+		glyphs[i].glyph.x = ROUND_26_6(*pen);
+		glyphs[i].glyph.y = y;
+
+		if (pos[i].x_advance)
+			*pen += pos[i].x_advance;
+		else
+			*pen += glyph_metrics_get(dc, font, infos[i].codepoint)->x_advance;
+	}
+	return i;
+}
+
+/**
+ * load_glyphs() - load XGlyphFontSpec from specified str.
+ * @dc: draw context.
+ * @str: utf-8 string.
+ * @glyphs: (out) XCharFontSpec *.
+ * @nglyph: length of glyphs.
+ * @width: (out) rendering width.
+ *
+ * Return: number of loaded glyphs.
+ */
+int
+load_glyphs(draw_context_t *dc, const char *str, glyph_font_spec_t *glyphs, int nglyph, int *width)
+{
+	glyph_run_t *run;
+	uint32_t hash = strhash(str);
+	bool complete;
+	int i, num;
+
+	/* reuse the shaped run if the string was shaped before */
+	if ((run = glyph_run_lookup(str, hash))) {
+		num = SMALLER(run->nglyph, nglyph);
+		memcpy(glyphs, run->glyphs, num * sizeof(glyph_font_spec_t));
+		for (i = 0; i < num; i++)
+			glyphs[i].font->used = nframe;
+		/* a truncated run ends where the first dropped glyph starts */
+		*width = num < run->nglyph ? (int)run->glyphs[num].glyph.x : run->width;
+		return num;
+	}
+
+	num = shape_glyphs(dc, str, glyphs, nglyph, width, &complete);
+	if (complete)
+		glyph_run_store(str, hash, glyphs, num, *width);
+
+	return num;
+}
+
+/**
+ * shape_glyphs() - shape specified str with resolved fonts.
+ * @dc: draw context.
+ * @str: utf-8 string.
+ * @glyphs: (out) shaped glyphs.
+ * @nglyph: length of glyphs.
+ * @width: (out) rendering width.
+ * @complete: (out) false if str is truncated or has unresolved runes.
+ *
+ * Return: number of shaped glyphs.
+ */
+int
+shape_glyphs(draw_context_t *dc, const char *str, glyph_font_spec_t *glyphs, int nglyph, int *width, bool *complete)
+{
+	FcChar32 rune = 0;
+	int i, y, len = 0;
+	size_t offset = 0, num = 0, slen = strlen(str);
+	font_t *font = NULL, *prev = NULL;
+	hb_buffer_t *buffer = shape_buffer;
+	hb_position_t pen = 0;
+	bool pending = false;
+
+	hb_buffer_clear_contents(buffer);
+
+	y = get_baseline();
+	for (i = 0; offset < slen && i < nglyph; i++, offset += len) {
+		if ((len = FcUtf8ToUcs4((FcChar8 *)&str[offset], &rune, slen - offset)) <= 0) {
+			rune = 0xFFFD;
+			len = 1;
+		}
+		if (!get_font(rune, &font) && !rune_missing(rune))
+			pending = true;
+		if (font && prev && prev != font) {
+			num += load_glyphs_from_hb_buffer(dc, buffer, prev, &pen, y, &glyphs[num], nglyph - num);
+			hb_buffer_clear_contents(buffer);
+		}
+		prev = font;
+		hb_buffer_add_codepoints(buffer, &rune, 1, 0, 1);
+	}
+	if (prev && hb_buffer_get_length(buffer))
+		num += load_glyphs_from_hb_buffer(dc, buffer, prev, &pen, y, &glyphs[num], nglyph - num);
+
+	*width = CEIL_26_6(pen);
+
+	/* truncated runs and runs with runes not resolved yet should be reshaped */
+	*complete = offset >= slen && !pending;
+
+	return num;
+}
+
+/**
+ * glyph_run_cache_init() - initialize the cache of shaped glyph runs.
+ */
+void
+glyph_run_cache_init()
+{
+	int i;
+
+	list_head_init(&run_cache.lru);
+	for (i = 0; i < RUN_CACHE_NBUCKET; i++)
+		list_head_init(&run_cache.buckets[i]);
+}
+
+/**
+ * glyph_run_cache_destroy() - free all cached glyph runs.
+ */
+void
+glyph_run_cache_destroy()
+{
+	int i;
+
+	for (i = 0; i < run_cache.nrun; i++) {
+		free(run_cache.runs[i].str);
+		free(run_cache.runs[i].glyphs);
+	}
+	memset(&run_cache, 0, sizeof(run_cache));
+}
+
+/**
+ * glyph_run_lookup() - find a shaped glyph run of the string.
+ * @str: utf-8 string.
+ * @hash: hash of str.
+ *
+ * The found run is moved to the head of LRU list.
+ *
+ * Return: glyph_run_t * or NULL.
+ */
+glyph_run_t *
+glyph_run_lookup(const char *str, uint32_t hash)
+{
+	list_head *pos, *bucket = &run_cache.buckets[hash % RUN_CACHE_NBUCKET];
+	glyph_run_t *run;
+
+	list_for_each(bucket, pos) {
+		run = list_entry(pos, glyph_run_t, bucket);
+		if (run->hash != hash || run->font != &bar.font || strcmp(run->str, str))
+			continue;
+		list_del(&run->lru);
+		list_add(&run_cache.lru, &run->lru);
+		run_cache.hits++;
+		return run;
+	}
+	run_cache.misses++;
+	return NULL;
+}
+
+/**
+ * glyph_run_store() - store a shaped glyph run of the string.
+ * @str: utf-8 string.
+ * @hash: hash of str.
+ * @glyphs: shaped glyphs.
+ * @nglyph: length of glyphs.
+ * @width: rendering width of glyphs.
+ *
+ * The least recently used run is evicted when the cache is full.
+ */
+void
+glyph_run_store(const char *str, uint32_t hash, const glyph_font_spec_t *glyphs, int nglyph, int width)
+{
+	glyph_run_t *run;
+
+	if (run_cache.nrun < RUN_CACHE_SIZE) {
+		run = &run_cache.runs[run_cache.nrun++];
+	} else {
+		run = list_entry(run_cache.lru.prev, glyph_run_t, lru);
+		list_del(&run->lru);
+		list_del(&run->bucket);
+		free(run->str);
+		free(run->glyphs);
+	}
+
+	run->hash = hash;
+	run->str = strdup(str);
+	run->font = &bar.font;
+	run->glyphs = malloc(nglyph * sizeof(glyph_font_spec_t));
+	nalloc += 2;
+	memcpy(run->glyphs, glyphs, nglyph * sizeof(glyph_font_spec_t));
+	run->nglyph = nglyph;
+	run->width = width;
+
+	list_add(&run_cache.lru, &run->lru);
+	list_add(&run_cache.buckets[hash % RUN_CACHE_NBUCKET], &run->bucket);
+}
+
+/**
+ * glyph_run_invalidate() - drop glyph runs that refer the font.
+ * @font: evicted font.
+ *
+ * Dropped runs are moved to the tail of LRU list to be reused first.
+ */
+void
+glyph_run_invalidate(font_t *font)
+{
+	glyph_run_t *run;
+	int i, j;
+
+	for (i = 0; i < run_cache.nrun; i++) {
+		run = &run_cache.runs[i];
+		for (j = 0; j < run->nglyph; j++)
+			if (run->glyphs[j].font == font)
+				break;
+		if (j == run->nglyph)
+			continue;
+
+		list_del(&run->bucket);
+		list_head_init(&run->bucket);
+		list_del(&run->lru);
+		list_add_tail(&run_cache.lru, &run->lru);
+		free(run->str);
+		free(run->glyphs);
+		run->str = NULL;
+		run->glyphs = NULL;
+		run->nglyph = 0;
+	}
+}
+
+/**
+ * draw_padding_em() - render padding by em units.
+ * @dc: DC.
+ * @num: padding width.
+ */
+void
+draw_padding_em(draw_context_t *dc, double em)
+{
+	draw_padding(dc, celwidth * em);
+}
+
+/**
+ * draw_padding() - render padding.
+ * @dc: DC.
+ * @num: padding width.
+ */
+void
+draw_padding(draw_context_t *dc, int num)
+{
+	dc->x += num;
+}
+
+/**
+ * draw_color_text() - render text with color.
+ * @dc: DC.
+ * @color: rendering text color.
+ * @str: rendering text.
+ */
+void
+draw_color_text(draw_context_t *dc, color_t *color, const char *str)
+{
+	int width;
+	size_t nglyph = load_glyphs(dc, str, glyph_caches, LENGTH(glyph_caches), &width);
+	dc_calc_render_pos(dc, glyph_caches, nglyph);
+	draw_glyphs(dc, color, glyph_caches, nglyph);
+	dc_move_x(dc, width);
+}
+
+/**
+ * numeric_glyphs() - get pre-shaped glyphs of NUMERIC_CHARS of the font.
+ * @dc: draw context.
+ * @font: font_t
+ *
+ * Characters are shaped one by one with tabular figures on first call, and
+ * digits are aligned to the widest one for fonts without tabular figures.
+ *
+ * Return: numeric_glyph_t * indexed by ASCII code.
+ */
+numeric_glyph_t *
+numeric_glyphs(draw_context_t *dc, font_t *font)
+{
+	hb_buffer_t *buffer;
+	hb_feature_t tnum;
+	hb_glyph_info_t *info;
+	hb_glyph_position_t *pos;
+	numeric_glyph_t *ng;
+	hb_position_t maxadv = 0;
+	unsigned int ninfo;
+	const char *c;
+
+	if (font->numerics)
+		return font->numerics;
+
+	font->numerics = calloc(128, sizeof(numeric_glyph_t));
+	hb_feature_from_string("tnum", -1, &tnum);
+	buffer = hb_buffer_create();
+	for (c = NUMERIC_CHARS; *c; c++) {
+		hb_buffer_clear_contents(buffer);
+		hb_buffer_add_utf8(buffer, c, 1, 0, 1);
+		hb_buffer_guess_segment_properties(buffer);
+		hb_shape(font->hb, buffer, &tnum, 1);
+		info = hb_buffer_get_glyph_infos(buffer, &ninfo);
+		pos = hb_buffer_get_glyph_positions(buffer, NULL);
+		if (ninfo != 1 || !info[0].codepoint)
+			continue;
+
+		ng = &font->numerics[(int)*c];
+		ng->glyph = info[0].codepoint;
+		ng->advance = pos[0].x_advance;
+		if (!ng->advance)
+			ng->advance = glyph_metrics_get(dc, font, ng->glyph)->x_advance;
+		if (BETWEEN(*c, '0', '9'))
+			maxadv = BIGGER(maxadv, ng->advance);
+	}
+	hb_buffer_destroy(buffer);
+
+	for (c = "0123456789"; *c; c++) {
+		ng = &font->numerics[(int)*c];
+		ng->offset = (maxadv - ng->advance) / 2;
+		ng->advance = maxadv;
+	}
+	return font->numerics;
+}
+
+/**
+ * text_run_new() - shape a constant string into a text run.
+ * @dc: draw context.
+ * @str: utf-8 string.
+ *
+ * Return: text_run_t *
+ */
+text_run_t *
+text_run_new(draw_context_t *dc, const char *str)
+{
+	text_run_t *run = calloc(1, sizeof(text_run_t));
+
+	run->str = strdup(str);
+	text_run_shape(dc, run);
+	list_add_tail(&text_runs, &run->head);
+
+	return run;
+}
+
+/**
+ * text_run_shape() - shape the string of the text run.
+ * @dc: draw context.
+ * @run: text_run_t
+ *
+ * Fonts of shaped glyphs are pinned to keep them loaded, and fonts of the
+ * glyphs shaped before are unpinned.
+ */
+void
+text_run_shape(draw_context_t *dc, text_run_t *run)
+{
+	int i, num;
+
+	text_run_unpin(run);
+	num = shape_glyphs(dc, run->str, glyph_caches, LENGTH(glyph_caches), &run->width, &run->complete);
+	/* runs waiting for fonts are shaped again on every frame */
+	if (!run->glyphs || num != run->nglyph) {
+		free(run->glyphs);
+		run->glyphs = malloc(num * sizeof(glyph_font_spec_t));
+		nalloc++;
+	}
+	memcpy(run->glyphs, glyph_caches, num * sizeof(glyph_font_spec_t));
+	run->nglyph = num;
+	for (i = 0; i < num; i++)
+		run->glyphs[i].font->npin++;
+}
+
+/**
+ * text_run_unpin() - release fonts of glyphs of the text run.
+ * @run: text_run_t
+ */
+void
+text_run_unpin(text_run_t *run)
+{
+	int i;
+
+	for (i = 0; i < run->nglyph; i++)
+		run->glyphs[i].font->npin--;
+}
+
+/**
+ * text_runs_init() - shape constant strings of modules.
+ * @dc: draw context.
+ * @mods: modules.
+ * @nmod: number of modules.
+ */
+void
+text_runs_init(draw_context_t *dc, module_t *mods, size_t nmod)
+{
+	module_t *mod;
+	size_t i;
+
+	for (i = 0; i < nmod; i++) {
+		mod = &mods[i];
+		if (mod->any.prefix && !mod->any.prefix_run)
+			mod->any.prefix_run = text_run_new(dc, mod->any.prefix);
+		if (mod->any.suffix && !mod->any.suffix_run)
+			mod->any.suffix_run = text_run_new(dc, mod->any.suffix);
+
+		if (mod->any.func == desktops) {
+			if (mod->desk.focused && !mod->desk.focused_run)
+				mod->desk.focused_run = text_run_new(dc, mod->desk.focused);
+			if (mod->desk.unfocused && !mod->desk.unfocused_run)
+				mod->desk.unfocused_run = text_run_new(dc, mod->desk.unfocused);
+		} else if (mod->any.func == text) {
+			if (mod->text.label && !mod->text.label_run)
+				mod->text.label_run = text_run_new(dc, mod->text.label);
+		} else if (mod->any.func == windowtitle) {
+			if (mod->title.ellipsis && !mod->title.ellipsis_run)
+				mod->title.ellipsis_run = text_run_new(dc, mod->title.ellipsis);
+		}
+	}
+}
+
+/**
+ * text_runs_destroy() - free all text runs.
+ */
+void
+text_runs_destroy()
+{
+	list_head *pos, *tmp;
+	text_run_t *run;
+
+	list_for_each_safe(&text_runs, pos, tmp) {
+		run = list_entry(pos, text_run_t, head);
+		text_run_unpin(run);
+		free(run->str);
+		free(run->glyphs);
+		free(run);
+	}
+	list_head_init(&text_runs);
+}
+
+/**
+ * draw_color_text_run() - render constant text with color.
+ * @dc: draw context.
+ * @color: foreground color.
+ * @run: (in/out) shaped run of str, it is shaped on first call if NULL.
+ * @str: utf-8 string.
+ */
+void
+draw_color_text_run(draw_context_t *dc, color_t *color, text_run_t **run, const char *str)
+{
+	if (!str)
+		return;
+	if (!*run)
+		*run = text_run_new(dc, str);
+	else if (!(*run)->complete)
+		text_run_shape(dc, *run);
+
+	memcpy(glyph_caches, (*run)->glyphs, (*run)->nglyph * sizeof(glyph_font_spec_t));
+	dc_calc_render_pos(dc, glyph_caches, (*run)->nglyph);
+	draw_glyphs(dc, color, glyph_caches, (*run)->nglyph);
+	dc_move_x(dc, (*run)->width);
+}
+
+/**
+ * draw_text_run() - render constant text.
+ * @dc: draw context.
+ * @run: (in/out) shaped run of str, it is shaped on first call if NULL.
+ * @str: utf-8 string.
+ */
+void
+draw_text_run(draw_context_t *dc, text_run_t **run, const char *str)
+{
+	draw_color_text_run(dc, bar.fg, run, str);
+}
+
+/**
+ * draw_numeric() - render numeric text without shaping.
+ * @dc: draw context.
+ * @str: text consists of NUMERIC_CHARS.
+ *
+ * The text is drawn by draw_text() if it contains other characters.
+ */
+void
+draw_numeric(draw_context_t *dc, const char *str)
+{
+	numeric_glyph_t *ng, *numerics = numeric_glyphs(dc, &bar.font);
+	hb_position_t pen = 0;
+	int i, y = get_baseline();
+
+	for (i = 0; str[i]; i++) {
+		if ((unsigned char)str[i] >= 128 || !numerics[(int)str[i]].glyph ||
+		    i >= (int)LENGTH(glyph_caches)) {
+			draw_text(dc, str);
+			return;
+		}
+		ng = &numerics[(int)str[i]];
+		glyph_caches[i].font = &bar.font;
+		glyph_caches[i].glyph.index = ng->glyph;
+		glyph_caches[i].glyph.x = ROUND_26_6(pen + ng->offset);
+		glyph_caches[i].glyph.y = y;
+		pen += ng->advance;
+	}
+
+	dc_calc_render_pos(dc, glyph_caches, i);
+	draw_glyphs(dc, bar.fg, glyph_caches, i);
+	dc_move_x(dc, CEIL_26_6(pen));
+}
+
+/**
+ * draw_glyphs() - draw text use loaded glyphs.
+ * @dc: draw context.
+ * @color: foreground color.
+ * @specs: loaded glyphs.
+ * @len: max length of specs.
+ */
+void
+draw_glyphs(draw_context_t *dc, color_t *color, const glyph_font_spec_t *specs, int len)
+{
+	cairo_font_face_t *prev = NULL;
+	glyph_metrics_t *m;
+	int i;
+
+	if (dc->stale)
+		color = bar.stale;
+	cairo_set_font_options(dc->cr, bar.font_opt);
+	cairo_set_font_size(dc->cr, bar.font_size);
+	cairo_set_source_rgb(dc->cr, CONVCOL(color->red), CONVCOL(color->green), CONVCOL(color->blue));
+	for (i = 0; i < len; i++) {
+		FRAME_HASH(specs[i].glyph.index ^ ((uint32_t)specs[i].glyph.x << 16));
+		/* composite cached rasters of color bitmap glyphs */
+		if (FT_HAS_COLOR(specs[i].font->face)) {
+			m = glyph_raster_get(dc, specs[i].font, specs[i].glyph.index);
+			/* font face of dc may be changed on measuring */
+			prev = NULL;
+			if (m->bitmap) {
+				if (m->raster)
+					draw_raster(dc, m, specs[i].glyph.x, specs[i].glyph.y);
+				continue;
+			}
+		}
+		if (prev != specs[i].font->cairo) {
+			prev = specs[i].font->cairo;
+			cairo_set_font_face(dc->cr, prev);
+		}
+		cairo_show_glyphs(dc->cr, (cairo_glyph_t *)&specs[i].glyph, 1);
+	}
+}
+
+/**
+ * draw_raster() - composite the raster of the color glyph.
+ * @dc: draw context.
+ * @m: glyph_metrics_t that has the raster.
+ * @x: x of the glyph origin.
+ * @y: y of the glyph origin.
+ *
+ * The operator of dc is SOURCE, which is unbounded for paints, so the raster
+ * is composited with OVER and only within its own extents.
+ */
+void
+draw_raster(draw_context_t *dc, const glyph_metrics_t *m, double x, double y)
+{
+	x += m->raster_x;
+	y += m->raster_y;
+	cairo_save(dc->cr);
+	cairo_set_operator(dc->cr, CAIRO_OPERATOR_OVER);
+	cairo_set_source_surface(dc->cr, m->raster, x, y);
+	cairo_rectangle(dc->cr, x, y, m->raster_w, m->raster_h);
+	cairo_fill(dc->cr);
+	cairo_restore(dc->cr);
+}
+
+/**
+ * draw_text() - render text.
+ * @dc: draw context.
+ * @str: rendering text.
+ */
+void
+draw_text(draw_context_t *dc, const char *str)
+{
+	draw_color_text(dc, bar.fg, str);
+}
+
+/**
+ * draw_bargraph() - render bar graph.
+ * @dc: draw context.
+ * @label: label of the graph.
+ * @items: items of the Graph.
+ * @nitem: number of items.
+ */
+void
+draw_bargraph(draw_context_t *dc, const char *label, graph_item_t *items, int nitem)
+{
+	xcb_rectangle_t rect = { 0 };
+
+	int width = (celwidth + 1) * nitem;
+	draw_color_text(dc, bar.fg, label);
+	int x = dc_get_x(dc) + celwidth;
+	for (int i = 0; i < nitem; i++) {
+		xcb_gc_color(bar.xcb, dc->gc, items[i].bg);
+		rect.x = x - celwidth;
+		rect.y = graph_basey;
+		rect.width = celwidth;
+		rect.height = graph_maxh;
+		xcb_poly_fill_rectangle(bar.xcb, dc->tmp->pixmap, dc->gc, 1, &rect);
+
+		if (items[i].val < 0)
+			goto CONTINUE;
+
+		xcb_gc_color(bar.xcb, dc->gc, dc->stale ? bar.stale : items[i].fg);
+		rect.width = celwidth;
+		rect.height = SMALLER(BIGGER(graph_maxh * items[i].val, 1), graph_maxh);;
+		rect.x = x - celwidth;
+		rect.y = graph_basey + (graph_maxh - rect.height);
+		xcb_poly_fill_rectangle(bar.xcb, dc->tmp->pixmap, dc->gc, 1, &rect);
+	CONTINUE:
+		x += celwidth + 1;
+	}
+	dc_move_x(dc, width);
+}
+
+/**
+ * text() - render the specified text.
+ * @dc: draw context.
+ * @opts: module options.
+ */
+void
+text(draw_context_t *dc, module_option_t *opts)
+{
+	color_t *fg = bar.fg;
+	if (opts->text.fg)
+		fg = color_load(opts->text.fg);
+	draw_color_text_run(dc, fg, &opts->text.label_run, opts->text.label);
+}
+
+/**
+ * render_labels() - render all labels
+ * @dc: DC.
+ * @labels: label_t array.
+ * @nlabel: length of labels.
+ */
+void
+render_labels(draw_context_t *dc, label_t *labels, size_t nlabel)
+{
+	size_t i;
+	int x = 0;
+
+	for (i = 0; i < nlabel; i++) {
+		if (!labels[i].option->any.func)
+			continue;
+
+		x = dc_get_x(dc);
+
+		draw_padding(dc, celwidth);
+		draw_option = labels[i].option;
+		dc->stale = module_stale(labels[i].option);
+		labels[i].option->any.func(dc, labels[i].option);
+		draw_option = NULL;
+		dc->stale = false;
+		draw_padding(dc, celwidth);
+		labels[i].width = dc_get_x(dc) - x;
+		labels[i].x = x;
+		if (labels[i].width == celwidth * 2) {
+			dc->x = x;
+			labels[i].width = 0;
+			continue;
+		}
+		dc->width += labels[i].width;
+	}
+}
+
+/**
+ * render_label() - re-render a label in place and present it.
+ * @dc: DC.
+ * @label: label_t positioned by the last frame.
+ *
+ * Return: false if the width of the label has been changed, then the
+ *         whole bar must be rendered.
+ */
+bool
+render_label(draw_context_t *dc, label_t *label)
+{
+	xcb_rectangle_t rect = { 0 };
+	window_t *xw = &dc->xbar;
+
+	if (!label->width)
+		return false;
+
+	dc_arena_reset(dc);
+	rect.width = label->width;
+	rect.height = xw->height;
+	xcb_gc_color(bar.xcb, dc->gc, bar.bg);
+	xcb_poly_fill_rectangle(bar.xcb, dc->tmp->pixmap, dc->gc, 1, &rect);
+
+	dc->x = dc->width = 0;
+	draw_padding(dc, celwidth);
+	draw_option = label->option;
+	dc->stale = module_stale(label->option);
+	label->option->any.func(dc, label->option);
+	draw_option = NULL;
+	dc->stale = false;
+	draw_padding(dc, celwidth);
+	if (dc_get_x(dc) != label->width)
+		return false;
+
+	xcb_copy_area(bar.xcb, dc->tmp->pixmap, dc->buf->pixmap, dc->gc, 0, 0, label->x, 0, label->width, xw->height);
+	xcb_copy_area(bar.xcb, dc->buf->pixmap, xw->win, dc->gc, label->x, 0, label->x, 0, label->width, xw->height);
+	return true;
+}
+
+/**
+ * render_option() - re-render labels of the module on all monitors.
+ * @opt: module option.
+ *
+ * Return: false if any label needs the whole bar to be rendered.
+ */
+bool
+render_option(module_option_t *opt)
+{
+	draw_context_t *dc;
+	size_t i;
+	int j;
+
+	for (j = 0; j < bar.ndc; j++) {
+		dc = &bar.dcs[j];
+		for (i = 0; i < dc->nleft; i++)
+			if (dc->left_labels[i].option == opt && !render_label(dc, &dc->left_labels[i]))
+				return false;
+		for (i = 0; i < dc->nright; i++)
+			if (dc->right_labels[i].option == opt && !render_label(dc, &dc->right_labels[i]))
+				return false;
+	}
+	xcb_flush(bar.xcb);
+	return true;
+}
+
+/**
+ * label_hitboxes_update() - publish positions of presented labels.
+ *
+ * Clicks are dispatched by the event thread with these while the next
+ * frame is rendered.
+ */
+void
+label_hitboxes_update()
+{
+	draw_context_t *dc;
+	size_t i;
+	int j;
+
+	pthread_mutex_lock(&renderer.lock);
+	for (j = 0; j < bar.ndc; j++) {
+		dc = &bar.dcs[j];
+		for (i = 0; i < dc->nleft; i++) {
+			dc->left_labels[i].hitx = dc->left_labels[i].x;
+			dc->left_labels[i].hitwidth = dc->left_labels[i].width;
+		}
+		for (i = 0; i < dc->nright; i++) {
+			dc->right_labels[i].hitx = dc->right_labels[i].x;
+			dc->right_labels[i].hitwidth = dc->right_labels[i].width;
+		}
+	}
+	pthread_mutex_unlock(&renderer.lock);
+}
+
+/**
+ * render_frame() - render the requested frame.
+ * @full: render the whole bar.
+ * @opts: modules whose labels are re-rendered.
+ * @nopt: length of opts.
+ *
+ * The whole bar is rendered if a label can not be re-rendered in place.
+ * States published by the event thread are read in a snapshot read section,
+ * so they are not freed while the frame is rendered.
+ */
+void
+render_frame(bool full, module_option_t **opts, int nopt)
+{
+	int i;
+
+	pthread_mutex_lock(&renderer.frame);
+	snapshot_read_lock();
+	font_worker_apply();
+	for (i = 0; !full && i < nopt; i++)
+		if (!render_option(opts[i]))
+			full = true;
+	if (full)
+		renderer.render();
+	snapshot_read_unlock();
+	pthread_mutex_unlock(&renderer.frame);
+
+	label_hitboxes_update();
+}
+
+/**
+ * render_request() - request a frame to the render thread.
+ * @opt: module to re-render its labels, or NULL for the whole bar.
+ *
+ * Requests made while a frame is in flight are merged into the next frame.
+ * The frame is rendered in place if the render thread is not running.
+ */
+void
+render_request(module_option_t *opt)
+{
+	renderer_t *r = &renderer;
+	int i;
+
+	if (!r->running) {
+		render_frame(!opt, &opt, !!opt);
+		return;
+	}
+
+	pthread_mutex_lock(&r->lock);
+	if (r->full || r->nopt)
+		nmerge++;
+	if (r->busy)
+		ninflight++;
+	if (!opt) {
+		r->full = true;
+	} else if (!r->full) {
+		for (i = 0; i < r->nopt && r->opts[i] != opt; i++)
+			;
+		if (i == r->nopt && r->nopt < RENDER_QUEUE_SIZE)
+			r->opts[r->nopt++] = opt;
+		else if (i == r->nopt)
+			r->full = true;
+	}
+	pthread_cond_signal(&r->cond);
+	pthread_mutex_unlock(&r->lock);
+}
+
+/**
+ * render_thread_run() - main loop of the render thread.
+ * @arg: renderer_t *
+ *
+ * Return: NULL
+ */
+void *
+render_thread_run(void *arg)
+{
+	renderer_t *r = arg;
+	module_option_t *opts[RENDER_QUEUE_SIZE];
+	bool full;
+	int nopt;
+
+	pthread_mutex_lock(&r->lock);
+	while (r->running) {
+		if (!r->full && !r->nopt) {
+			pthread_cond_wait(&r->cond, &r->lock);
+			continue;
+		}
+		full = r->full;
+		nopt = full ? 0 : r->nopt;
+		memcpy(opts, r->opts, nopt * sizeof(module_option_t *));
+		r->full = false;
+		r->nopt = 0;
+		r->busy = true;
+		pthread_mutex_unlock(&r->lock);
+
+		render_frame(full, opts, nopt);
+		render_thread_wake();
+
+		pthread_mutex_lock(&r->lock);
+		r->busy = false;
+	}
+	pthread_mutex_unlock(&r->lock);
+
+	return NULL;
+}
+
+/**
+ * render_thread_wake() - wake the event thread for X input read by cairo.
+ *
+ * Frames make no round trips of their own, but cairo may wait for replies
+ * while it draws, and events and replies read from the connection then do
+ * not wake the event thread up. The event thread takes them from the queue
+ * of xcb in order, so nothing is read from the queue on this thread.
+ */
+void
+render_thread_wake()
+{
+	if (write(renderer.pipe[1], "", 1) == -1 && errno != EAGAIN)
+		err("write(): failed to wake the event thread\n");
+}
+
+/**
+ * render_thread_handle() - PollUpdateHandler for the render thread.
+ * @fd: read end of the pipe.
+ *
+ * Return: poll_result_t of xev_dispatch().
+ */
+poll_result_t
+render_thread_handle(int fd)
+{
+	char drain[64];
+	ssize_t n;
+
+	while ((n = read(fd, drain, sizeof(drain))) > 0)
+		renderer.pollfd.nevent += n;
+	return xev_dispatch(false);
+}
+
+/**
+ * render_thread_release() - PollDeinitHandler for the render thread.
+ *
+ * Return: 0
+ */
+int
+render_thread_release()
+{
+	renderer_t *r = &renderer;
+
+	close(r->pipe[0]);
+	close(r->pipe[1]);
+	return 0;
+}
+
+/**
+ * render_thread_start() - start the render thread.
+ *
+ * Signals are blocked on the thread, so they interrupt the event thread.
+ *
+ * Return: false if frames are rendered by the event thread.
+ */
+bool
+render_thread_start()
+{
+	renderer_t *r = &renderer;
+	sigset_t set, old;
+
+	if (pipe(r->pipe) == -1) {
+		err("pipe(): failed to create pipe for render thread\n");
+		return false;
+	}
+	fcntl(r->pipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(r->pipe[1], F_SETFL, O_NONBLOCK);
+	r->pollfd.fd = r->pipe[0];
+	r->pollfd.handler = render_thread_handle;
+	r->pollfd.deinit = render_thread_release;
+	r->pollfd.name = "render";
+	poll_add(&r->pollfd);
+
+	sigfillset(&set);
+	pthread_sigmask(SIG_SETMASK, &set, &old);
+	r->running = true;
+	if (pthread_create(&r->thread, NULL, render_thread_run, r)) {
+		err("pthread_create(): failed to start render thread\n");
+		r->running = false;
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	return r->running;
+}
+
+/**
+ * render_thread_stop() - wait the frame in flight and stop the render thread.
+ */
+void
+render_thread_stop()
+{
+	renderer_t *r = &renderer;
+
+	if (!r->running)
+		return;
+	pthread_mutex_lock(&r->lock);
+	r->running = false;
+	pthread_cond_signal(&r->cond);
+	pthread_mutex_unlock(&r->lock);
+	pthread_join(r->thread, NULL);
+}
+
+/**
+ * xcb_gc_color() - set foreground color to xcb_gcontext_t
+ * @xcb: xcb connection.
+ * @gc: xcb_gcontext_t
+ * @color: foreground color.
+ */
+void
+xcb_gc_color(xcb_connection_t *xcb, xcb_gcontext_t gc, color_t *color)
+{
+	xcb_change_gc_value_list_t values = { .foreground = color->pixel };
+	xcb_change_gc_aux(xcb, gc, XCB_GC_FOREGROUND, &values);
+}
+
+/**
+ * calculate_systray_item_positions() - calculate position of tray items.
+ * @label: the label must has been made from systray module.
+ * @opts: module option.
+ */
+void
+calculate_systray_item_positions(label_t *label, module_option_t *opts)
+{
+	xcb_configure_window_value_list_t values;
+	uint32_t mask = XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y | XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT;
+	systray_item_t *item;
+	list_head *pos;
+	int x;
+
+	if (!systray_icon_size(tray))
+		systray_set_icon_size(tray, opts->tray.iconsize);
+
+	if (list_empty(systray_get_items(tray)))
+		return;
+
+	/* fix the position for padding */
+	x = label->x + celwidth;
+	list_for_each(systray_get_items(tray), pos) {
+		item = list_entry(pos, systray_item_t, head);
+		if (!item->info.flags)
+			continue;
+		if (item->x != x) {
+			values.x = x;
+			values.y = (BAR_HEIGHT - opts->tray.iconsize) / 2;
+			values.width = opts->tray.iconsize;
+			values.height = opts->tray.iconsize;
+			/* errors of gone items are ignored by the event thread */
+			xcb_configure_window_aux(bar.xcb, item->win, mask, &values);
+			item->x = x;
+			if (!item->mapped) {
+				xcb_map_window(bar.xcb, item->win);
+				item->mapped = true;
+			}
+		}
+		x += opts->tray.iconsize + celwidth;
+	}
+}
+
+/**
+ * calculate_label_positions() - calculate position of labels.
+ * @dc: draw_context_t
+ * @labels: label_t array.
+ * @nlabel: length of labels.
+ * @offset: position offset.
+ */
+void
+calculate_label_positions(draw_context_t *dc, label_t *labels, size_t nlabel, int offset)
+{
+	size_t i;
+	for (i = 0; i < nlabel; i++) {
+		labels[i].x += offset;
+
+		if (systray_get_window(tray) == dc->xbar.win && labels[i].option->any.func == systray)
+			calculate_systray_item_positions(&labels[i], labels[i].option);
+	}
+}
+
+/**
+ * render() - rendering all modules.
+ *
+ * Debug builds assert that a frame drawing the same glyphs and measuring the
+ * same runes as the last one is drawn from caches, without growing caches or
+ * arenas of the bar.
+ */
+void
+render()
+{
+#ifndef NDEBUG
+	static uint32_t prevhash = 0;
+	static bool drawn = false;
+#endif
+	draw_context_t *dc;
+	window_t *xw;
+	xcb_rectangle_t rect = { 0 };
+	unsigned long prevalloc;
+	int i;
+
+	/* arenas grow for the peak of the last frame */
+	for (i = 0; i < bar.ndc; i++)
+		dc_arena_reset(&bar.dcs[i]);
+	prevalloc = nalloc;
+#ifndef NDEBUG
+	frame_hash = 2166136261;
+#endif
+
+	nframe++;
+	for (i = 0; i < bar.ndc; i++) {
+		dc = &bar.dcs[i];
+		xw = &dc->xbar;
+		rect.width = xw->width;
+		rect.height = xw->height;
+
+		xcb_gc_color(bar.xcb, dc->gc, bar.bg);
+		xcb_poly_fill_rectangle(bar.xcb, dc->buf->pixmap, dc->gc, 1, &rect);
+
+		/* render left modules */
+		xcb_poly_fill_rectangle(bar.xcb, dc->tmp->pixmap, dc->gc, 1, &rect);
+		dc->x = dc->width = 0;
+		render_labels(dc, dc->left_labels, dc->nleft);
+		xcb_copy_area(bar.xcb, dc->tmp->pixmap, dc->buf->pixmap, dc->gc, 0, 0, celwidth, 0, dc->width, xw->height);
+		calculate_label_positions(dc, dc->left_labels, dc->nleft, celwidth);
+
+		/* render right modules */
+		xcb_poly_fill_rectangle(bar.xcb, dc->tmp->pixmap, dc->gc, 1, &rect);
+		dc->x = dc->width = 0;
+		render_labels(dc, dc->right_labels, dc->nright);
+		xcb_copy_area(bar.xcb, dc->tmp->pixmap, dc->buf->pixmap, dc->gc, 0, 0, xw->width - dc->width - celwidth, 0, dc->width, xw->height);
+		calculate_label_positions(dc, dc->right_labels, dc->nright, xw->width - dc->width - celwidth);
+
+		/* copy pixmap to window */
+		xcb_copy_area(bar.xcb, dc->buf->pixmap, xw->win, dc->gc, 0, 0, 0, 0, xw->width, xw->height);
+	}
+	xcb_flush(bar.xcb);
+
+	if (nalloc != prevalloc)
+		nallocframe++;
+#ifndef NDEBUG
+	assert(!drawn || frame_hash != prevhash || nalloc == prevalloc);
+	prevhash = frame_hash;
+	drawn = true;
+#endif
+}
+
+/**
+ * bspwmbar_init() - initialize bspwmbar.
+ * @dpy: display pointer.
+ * @scr: screen number.
+ *
+ * Return:
+ * 0 - success
+ * 1 - failure
+ */
+bool
+bspwmbar_init(xcb_connection_t *xcb, xcb_screen_t *scr)
+{
+	xcb_randr_get_monitors_reply_t *mon_reply;
+	xcb_randr_get_screen_resources_reply_t *screen_reply;
+	xcb_randr_get_output_info_reply_t *info_reply;
+	xcb_randr_output_t *outputs;
+	xcb_randr_get_crtc_info_reply_t *crtc_reply;
+	xcb_randr_get_output_primary_reply_t *primary_reply;
+	xcb_randr_output_t primary = XCB_NONE;
+	monitor_modules_t *mods;
+	char name[NAME_MAXSZ];
+	int i, nmon = 0;
+
+	/* initialize */
+	bar.xcb = xcb;
+	bar.scr = scr;
+	bar.cmap = scr->default_colormap;
+	bar.fg = color_load(FGCOLOR);
+	bar.bg = color_load(BGCOLOR);
+	bar.stale = color_load(STALEFGCOLOR);
+
+	/* get monitors */
+	mon_reply = xcb_randr_get_monitors_reply(xcb, xcb_randr_get_monitors(xcb, scr->root, 1), NULL);
+	bar.dcs = (draw_context_t *)calloc(mon_reply->nMonitors, sizeof(draw_context_t));
+	bar.ndc = mon_reply->nMonitors;
+
+	/* get primary output */
+	if ((primary_reply = xcb_randr_get_output_primary_reply(xcb, xcb_randr_get_output_primary(xcb, scr->root), NULL))) {
+		primary = primary_reply->output;
+		free(primary_reply);
+	}
+
+	/* create window per monitor */
+	screen_reply = xcb_randr_get_screen_resources_reply(xcb, xcb_randr_get_screen_resources(xcb, scr->root), NULL);
+	outputs = xcb_randr_get_screen_resources_outputs(screen_reply);
+	for (i = 0; i < screen_reply->num_outputs; i++) {
+		info_reply = xcb_randr_get_output_info_reply(xcb, xcb_randr_get_output_info(xcb, outputs[i], XCB_TIME_CURRENT_TIME), NULL);
+		if (info_reply->crtc != XCB_NONE) {
+			crtc_reply = xcb_randr_get_crtc_info_reply(xcb, xcb_randr_get_crtc_info(xcb, info_reply->crtc, XCB_TIME_CURRENT_TIME), NULL);
+			memset(name, 0, sizeof(name));
+			strncpy(name, (const char *)xcb_randr_get_output_info_name(info_reply), SMALLER(xcb_randr_get_output_info_name_length(info_reply), NAME_MAXSZ - 1));
+			/* the first monitor is the primary if no primary output is set */
+			mods = monitor_modules_find(name, primary ? outputs[i] == primary : !nmon);
+			if (dc_init(&bar.dcs[nmon], xcb, scr, mods, crtc_reply->x, crtc_reply->y, crtc_reply->width, BAR_HEIGHT))
+				strncpy(bar.dcs[nmon++].monitor_name, name, NAME_MAXSZ);
+			free(crtc_reply);
+		}
+		free(info_reply);
+	}
+	free(screen_reply);
+	free(mon_reply);
+
+	if (!nmon)
+		return false;
+
+	/* load_fonts */
+	if (!load_fonts(fontname))
+		return false;
+
+	/* scheduler of module samplers */
+	list_head_init(&scheds);
+	wheel = timer_wheel_new();
+
+	/* shape constant strings of modules */
+	list_head_init(&text_runs);
+	for (i = 0; i < (int)LENGTH(monitor_modules); i++) {
+		text_runs_init(&bar.dcs[0], monitor_modules[i].left, monitor_modules[i].nleft);
+		text_runs_init(&bar.dcs[0], monitor_modules[i].right, monitor_modules[i].nright);
+	}
+
+	xcb_flush(xcb);
+	return true;
+}
+
+/**
+ * font_destroy() - free all resources of font.
+ * @font: font_t
+ */
+void
+font_destroy(font_t font)
+{
+	cairo_font_face_destroy(font.cairo);
+	hb_font_destroy(font.hb);
+	pthread_mutex_lock(&ftlock);
+	FT_Done_Face(font.face);
+	pthread_mutex_unlock(&ftlock);
+	glyph_metrics_destroy(&font);
+	free(font.numerics);
+	free(font.ascii);
+	free(font.path);
+}
+
+/**
+ * font_caches_destroy() - free all resources of font caches.
+ */
+void
+font_caches_destroy()
+{
+	int i;
+	for (i = 0; i < nfcache; i++) {
+		font_destroy(*fcaches[i]);
+		free(fcaches[i]);
+	}
+	nfcache = 0;
+	fcachecap = 0;
+	if (fcaches)
+		free(fcaches);
+}
+
+/**
+ * bspwmbar_destroy() - destroy all resources of bspwmbar.
+ */
+void
+bspwmbar_destroy()
+{
+	list_head *cur;
+	int i;
+	list_head *pos;
+
+	list_for_each(&pollfds, cur)
+		poll_del(list_entry(cur, poll_fd_t, head));
+
+	/* font resources */
+	cairo_font_options_destroy(bar.font_opt);
+	font_destroy(bar.font);
+	text_runs_destroy();
+	scroll_destroy();
+	module_sched_destroy();
+	font_caches_destroy();
+	fontcache_destroy(bar.fontcache);
+	glyph_run_cache_destroy();
+	coverage_destroy();
+	hb_buffer_destroy(shape_buffer);
+	FcPatternDestroy(bar.pattern);
+	if (bar.set)
+		FcFontSetDestroy(bar.set);
+	free(bar.fallbacks);
+
+	/* deinit modules */
+	list_for_each(&pollfds, pos)
+		poll_del(list_entry(pos, poll_fd_t, head));
+	snapshot_publish(&wintitle, NULL, free);
+	snapshot_destroy();
+
+	/* rendering resources */
+	for (i = 0; i < bar.ndc; i++)
+		dc_free(bar.dcs[i]);
+	free(bar.dcs);
+}
+
+/**
+ * systray() - render systray.
+ * @dc: draw context.
+ * @opts: dummy.
+ */
+void
+systray(draw_context_t *dc, module_option_t *opts)
+{
+	list_head *pos, *base;
+	(void)opts;
+
+	if (!systray_icon_size(tray))
+		systray_set_icon_size(tray, opts->tray.iconsize);
+
+	if (list_empty(systray_get_items(tray)))
+		return;
+
+	if (systray_get_window(tray) != dc->xbar.win)
+		return;
+
+	/* render spaces for iconsize */
+	base = systray_get_items(tray);
+	list_for_each(base, pos) {
+		systray_item_t *item = list_entry(pos, systray_item_t, head);
+		if (!item->info.flags)
+			continue;
+		draw_padding(dc, opts->tray.iconsize);
+		if (base != pos->next)
+			draw_padding(dc, celwidth);
+	}
+}
+
+/**
+ * poll_stop() - stop polling to all file descriptor.
+ */
+void
+poll_stop()
+{
+	if (pfd > 0)
+		close(pfd);
+}
+
+/**
+ * poll_watch() - start polling the file descriptor.
+ * @pollfd: PollFD object.
+ *
+ * Return: bool
+ */
+bool
+poll_watch(poll_fd_t *pollfd)
+{
+#if defined(__linux)
+	struct epoll_event ev;
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = (void *)pollfd;
+
+	return epoll_ctl(pfd, EPOLL_CTL_ADD, pollfd->fd, &ev) != -1;
+#elif defined(__OpenBSD__) || defined(__FreeBSD__)
+	struct kevent ev = { 0 };
+
+	EV_SET(&ev, pollfd->fd, EVFILT_READ, EV_ADD, 0, 0, pollfd);
+	return kevent(pfd, &ev, 1, NULL, 0, NULL) != -1;
+#endif
+}
+
+/**
+ * poll_unwatch() - stop polling the file descriptor.
+ * @pollfd: PollFD object.
+ */
+void
+poll_unwatch(poll_fd_t *pollfd)
+{
+#if defined(__linux)
+	epoll_ctl(pfd, EPOLL_CTL_DEL, pollfd->fd, NULL);
+#elif defined(__OpenBSD__) || defined(__FreeBSD__)
+	struct kevent ev = { 0 };
+	EV_SET(&ev, pollfd->fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+	kevent(pfd, &ev, 1, NULL, 0, NULL);
+#endif
+}
+
+/**
+ * poll_add() - add the file descriptor to polling targets.
+ * @pollfd: PollFD object.
+ *
+ * A source with init which has failed to start is restarted later.
+ */
+void
+poll_add(poll_fd_t *pollfd)
+{
+	list_add_tail(&pollfds, &pollfd->head);
+	if (pollfd->fd >= 0 && poll_watch(pollfd))
+		return;
+	if (!poll_fail(pollfd))
+		die("poll_add(): failed to add %s to polling targets\n", pollfd->name ? pollfd->name : "fd");
+}
+
+/**
+ * poll_del() - delete the file descriptor from polling targets.
+ * @pollfd: PollFD object.
+ */
+void
+poll_del(poll_fd_t *pollfd)
+{
+	poll_restart_t *restart;
+
+	if (pollfd->fd >= 0) {
+		poll_unwatch(pollfd);
+		if (pollfd->deinit)
+			pollfd->deinit();
+	}
+	if (pollfd->release)
+		pollfd->release();
+	if ((restart = poll_restart_find(pollfd))) {
+		timer_del(&restart->timer);
+		list_del(&restart->head);
+		free(restart);
+	}
+	list_del(&pollfd->head);
+}
+
+/**
+ * poll_fail() - take down the failed source and schedule its restart.
+ * @pollfd: PollFD object.
+ *
+ * The source is restarted after RESTART_BACKOFF_MIN, and the delay is
+ * doubled up to RESTART_BACKOFF_MAX for every restart until the source
+ * stays up for RESTART_BACKOFF_MAX. States published by the source are not
+ * released, so the bar keeps showing the last known state meanwhile.
+ *
+ * Return: false if the source can not be restarted.
+ */
+bool
+poll_fail(poll_fd_t *pollfd)
+{
+	poll_restart_t *restart;
+	uint64_t now = timer_now();
+
+	if (!pollfd->init)
+		return false;
+	if (pollfd->fd >= 0) {
+		poll_unwatch(pollfd);
+		if (pollfd->deinit)
+			pollfd->deinit();
+		pollfd->fd = -1;
+	}
+	pollfd->ndown++;
+
+	if (!(restart = poll_restart_find(pollfd))) {
+		restart = calloc(1, sizeof(poll_restart_t));
+		restart->pollfd = pollfd;
+		restart->timer.func = poll_restart;
+		list_head_init(&restart->timer.head);
+		list_add_tail(&restarts, &restart->head);
+	}
+	if (!restart->backoff || now - restart->up >= RESTART_BACKOFF_MAX)
+		restart->backoff = RESTART_BACKOFF_MIN;
+	err("%s: source is down, restarting in %u ms\n",
+	    pollfd->name ? pollfd->name : "fd", restart->backoff);
+	poll_restart_arm(restart, now);
+	return true;
+}
+
+/**
+ * poll_restart_find() - find the restart of the source.
+ * @pollfd: PollFD object.
+ *
+ * Return: poll_restart_t or NULL if the source has never failed.
+ */
+poll_restart_t *
+poll_restart_find(poll_fd_t *pollfd)
+{
+	list_head *pos;
+	poll_restart_t *restart;
+
+	list_for_each(&restarts, pos) {
+		restart = list_entry(pos, poll_restart_t, head);
+		if (restart->pollfd == pollfd)
+			return restart;
+	}
+	return NULL;
+}
+
+/**
+ * poll_restart_arm() - schedule the next restart and back off.
+ * @restart: poll_restart_t
+ * @now: milliseconds of timer_now().
+ */
+void
+poll_restart_arm(poll_restart_t *restart, uint64_t now)
+{
+	timer_add(wheel, &restart->timer, now + restart->backoff);
+	restart->backoff = SMALLER(restart->backoff * 2, RESTART_BACKOFF_MAX);
+}
+
+/**
+ * poll_restart() - timer function of restarts.
+ * @timer: timer_entry_t of poll_restart_t
+ */
+void
+poll_restart(timer_entry_t *timer)
+{
+	poll_restart_t *restart = list_entry(timer, poll_restart_t, timer);
+	poll_fd_t *pollfd = restart->pollfd;
+
+	if ((pollfd->fd = pollfd->init()) >= 0 && poll_watch(pollfd)) {
+		pollfd->nup++;
+		restart->up = timer_now();
+		/* the source publishes its state on start */
+		sched_changed = true;
+		return;
+	}
+	if (pollfd->fd >= 0 && pollfd->deinit)
+		pollfd->deinit();
+	pollfd->fd = -1;
+	poll_restart_arm(restart, timer_now());
+}
+
+/**
+ * poll_init() - initialize poll.
+ *
+ * The function must be called before poll_add(), poll_del().
+ */
+void
+poll_init()
+{
+	list_head_init(&pollfds);
+	list_head_init(&restarts);
+	list_head_init(&scrolls);
+	list_head_init(&async_xcbs);
+	list_head_init(&async_fds);
+	list_head_init(&async_dead);
+}
+
+#if defined(__linux)
+/**
+ * timer_reset() - PollUpdateHandler for timer.
+ * @fd: timerfd.
+ *
+ * Due samplers are run by poll_loop() after every wakeup.
+ *
+ * Return: PollResult
+ *
+ * always - PR_NOOP
+ */
+poll_result_t
+timer_reset(int fd)
+{
+	uint64_t tcnt;
+	if (read(fd, &tcnt, sizeof(uint64_t)) < 0) {
+		if (errno != EAGAIN)
+			return PR_FAILED;
+		return PR_NOOP;
+	}
+	timer.nevent += tcnt;
+	return PR_NOOP;
+}
+
+/**
+ * timer_arm() - arm the timerfd once at the absolute deadline.
+ * @fd: timerfd of CLOCK_MONOTONIC.
+ * @deadline: milliseconds of timer_now(), or -1 to disarm.
+ *
+ * The timerfd is not touched if the deadline is not changed.
+ */
+void
+timer_arm(int fd, int64_t deadline)
+{
+	static int64_t armed = -1;
+	struct itimerspec spec = { 0 };
+
+	if (deadline == armed)
+		return;
+	armed = deadline;
+	if (deadline >= 0) {
+		spec.it_value.tv_sec = deadline / 1000;
+		spec.it_value.tv_nsec = deadline % 1000 * 1000000;
+		/* zero disarms the timer */
+		if (!spec.it_value.tv_sec && !spec.it_value.tv_nsec)
+			spec.it_value.tv_nsec = 1;
+	}
+	timerfd_settime(fd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+
+/**
+ * clock_watch() - create a timerfd cancelled when the wall clock is set.
+ *
+ * The timer never expires, it becomes readable with ECANCELED when the wall
+ * clock is stepped by settimeofday(2) or NTP, and when the system resumes.
+ *
+ * Return: timerfd or -1.
+ */
+int
+clock_watch()
+{
+	struct itimerspec spec = { 0 };
+	int fd;
+
+	if ((fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK)) == -1)
+		return -1;
+	spec.it_value.tv_sec = LONG_MAX;
+	if (timerfd_settime(fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &spec, NULL) == -1) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/**
+ * clock_unwatch() - close the timerfd of clock_watch().
+ *
+ * Return: 0
+ */
+int
+clock_unwatch()
+{
+	if (clockfd.fd >= 0)
+		close(clockfd.fd);
+	return 0;
+}
+
+/**
+ * clock_update() - PollUpdateHandler for changes of the wall clock.
+ * @fd: timerfd of clock_watch().
+ *
+ * Return: PR_NOOP, or PR_REINIT if the timer can not be armed again.
+ */
+poll_result_t
+clock_update(int fd)
+{
+	struct itimerspec spec = { 0 };
+	uint64_t tcnt;
+
+	if (read(fd, &tcnt, sizeof(uint64_t)) < 0 && errno != ECANCELED)
+		return errno == EAGAIN ? PR_NOOP : PR_REINIT;
+	clockfd.nevent++;
+	spec.it_value.tv_sec = LONG_MAX;
+	if (timerfd_settime(fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &spec, NULL) == -1)
+		return PR_REINIT;
+	clock_check(true);
+	return PR_NOOP;
+}
+
+#endif
+
+/**
+ * clock_ms() - get time of the clock in milliseconds.
+ * @clock: clockid_t
+ *
+ * Return: milliseconds
+ */
+int64_t
+clock_ms(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * clock_check() - resample modules after a jump of the wall clock or resume.
+ * @set: the wall clock is known to have been set.
+ *
+ * Deadlines are kept on the monotonic clock, which does not count suspended
+ * time, so aligned samplers would show the time of the suspend until their
+ * deadlines. All modules are sampled again and rearmed on the new wall
+ * clock, and after resume rate based samplers drop their baselines so rates
+ * are not computed across the suspend.
+ */
+void
+clock_check(bool set)
+{
+	int64_t now = timer_now(), wall, asleep = 0;
+	bool resumed, changed;
+	module_sched_t *sched;
+	list_head *pos;
+
+	wall = clock_ms(CLOCK_REALTIME) - now;
+#if defined(CLOCK_ASLEEP)
+	asleep = clock_ms(CLOCK_ASLEEP) - clock_ms(CLOCK_AWAKE);
+	resumed = asleep - clock_asleep >= CLOCK_JUMP;
+#else
+	/* the monotonic clock stops while suspended */
+	resumed = wall - clock_wall >= CLOCK_JUMP;
+#endif
+	changed = set || resumed || llabs(wall - clock_wall) >= CLOCK_JUMP;
+	/* the first call only records the offsets */
+	if (!clock_wall)
+		changed = false;
+	clock_wall = wall;
+	clock_asleep = asleep;
+	if (!changed)
+		return;
+	if (resumed)
+		nresume++;
+	else
+		nclockset++;
+
+	list_for_each(&scheds, pos) {
+		sched = list_entry(pos, module_sched_t, head);
+		if (resumed)
+			sched->reset = true;
+		module_refresh(sched->opts);
+	}
+}
+
+/**
+ * render_lock() - exclude frames while state read by them is modified.
+ *
+ * Modules modifying state which is not published as snapshots hold the lock
+ * on the event thread. It waits for the frame in flight.
+ */
+void
+render_lock()
+{
+	pthread_mutex_lock(&renderer.frame);
+}
+
+/**
+ * render_unlock() - release the lock taken by render_lock().
+ */
+void
+render_unlock()
+{
+	pthread_mutex_unlock(&renderer.frame);
+}
+
+/**
+ * async_new() - create a continuation.
+ * @timeout: deadline in milliseconds from now, 0 for no deadline.
+ * @func: continuation.
+ * @data: argument of func.
+ *
+ * Return: async_t *
+ */
+async_t *
+async_new(unsigned int timeout, async_func_t func, void *data)
+{
+	async_t *async = calloc(1, sizeof(async_t));
+
+	async->func = func;
+	async->data = data;
+	async->pollfd.fd = -1;
+	async->timer.func = async_expire;
+	list_head_init(&async->timer.head);
+	if (timeout)
+		timer_add(wheel, &async->timer, timer_now() + timeout);
+
+	nasync++;
+	if (++nasync_inflight > nasync_peak)
+		nasync_peak = nasync_inflight;
+	return async;
+}
+
+/**
+ * async_xcb() - continue with the reply of the xcb request.
+ * @sequence: sequence number of the cookie.
+ * @timeout: deadline in milliseconds from now, 0 for no deadline.
+ * @func: continuation.
+ * @data: argument of func.
+ *
+ * Replies are taken without blocking whenever the event thread wakes up, so
+ * requests made in a row are answered in one round trip. func is called on
+ * the event thread with the reply, which func must free, or with NULL if the
+ * request has failed or timed out.
+ *
+ * Return: async_t to cancel the request.
+ */
+async_t *
+async_xcb(unsigned int sequence, unsigned int timeout, async_func_t func, void *data)
+{
+	async_t *async = async_new(timeout, func, data);
+
+	async->sequence = sequence;
+	list_add_tail(&async_xcbs, &async->head);
+	return async;
+}
+
+/**
+ * async_fd() - continue when the file descriptor becomes readable.
+ * @fd: file descriptor, which is not closed by the request.
+ * @timeout: deadline in milliseconds from now, 0 for no deadline.
+ * @func: continuation.
+ * @data: argument of func.
+ *
+ * func is called on the event thread with NULL as the reply, and reads the
+ * file descriptor by itself.
+ *
+ * Return: async_t to cancel the request.
+ */
+async_t *
+async_fd(int fd, unsigned int timeout, async_func_t func, void *data)
+{
+	async_t *async = async_new(timeout, func, data);
+
+	async->pollfd.fd = fd;
+	async->pollfd.handler = async_fd_handle;
+	async->pollfd.name = "async";
+	poll_add(&async->pollfd);
+	list_add_tail(&async_fds, &async->head);
+	return async;
+}
+
+/**
+ * async_cancel() - cancel the request without calling the continuation.
+ * @async: async_t
+ */
+void
+async_cancel(async_t *async)
+{
+	if (async->pollfd.fd < 0)
+		xcb_discard_reply(bar.xcb, async->sequence);
+	async_free(async);
+}
+
+/**
+ * async_free() - free the continuation.
+ * @async: async_t
+ *
+ * Events of fd requests may be left in the poll batch, so they are freed by
+ * async_reap() after the batch.
+ */
+void
+async_free(async_t *async)
+{
+	timer_del(&async->timer);
+	list_del(&async->head);
+	nasync_inflight--;
+	if (async->pollfd.fd < 0) {
+		free(async);
+		return;
+	}
+	poll_del(&async->pollfd);
+	async->pollfd.handler = async_fd_dead;
+	list_add_tail(&async_dead, &async->head);
+}
+
+/**
+ * async_finish() - free the continuation and call it.
+ * @async: async_t
+ * @reply: reply of the request.
+ * @timedout: the deadline has passed.
+ *
+ * Return: true if the continuation needs rendering.
+ */
+bool
+async_finish(async_t *async, void *reply, bool timedout)
+{
+	async_func_t func = async->func;
+	void *data = async->data;
+
+	async_free(async);
+	return func(data, reply, timedout);
+}
+
+/**
+ * async_expire() - timer function of deadlines.
+ * @timer: timer_entry_t of async_t
+ */
+void
+async_expire(timer_entry_t *timer)
+{
+	async_t *async = list_entry(timer, async_t, timer);
+
+	nasync_timeout++;
+	if (async->pollfd.fd < 0)
+		xcb_discard_reply(bar.xcb, async->sequence);
+	if (async_finish(async, NULL, true))
+		sched_changed = true;
+}
+
+/**
+ * async_fd_handle() - PollUpdateHandler for fd requests.
+ * @fd: readable file descriptor.
+ *
+ * Return: poll_result_t
+ */
+poll_result_t
+async_fd_handle(int fd)
+{
+	list_head *pos;
+	async_t *async;
+
+	list_for_each(&async_fds, pos) {
+		async = list_entry(pos, async_t, head);
+		if (async->pollfd.fd != fd)
+			continue;
+		async->pollfd.nevent++;
+		return async_finish(async, NULL, false) ? PR_UPDATE : PR_NOOP;
+	}
+	return PR_NOOP;
+}
+
+/**
+ * async_fd_dead() - PollUpdateHandler for freed fd requests.
+ * @fd: file descriptor.
+ *
+ * Return: PR_NOOP
+ */
+poll_result_t
+async_fd_dead(int fd)
+{
+	(void)fd;
+	return PR_NOOP;
 }
 
 /**
- * draw_padding() - render padding.
- * @dc: DC.
- * @num: padding width.
+ * async_dispatch() - call continuations of arrived replies.
+ *
+ * Replies arrive in order of requests, so the dispatch stops at the first
+ * request which has not been answered yet.
+ *
+ * Return: true if some continuation needs rendering.
  */
-void
-draw_padding(draw_context_t *dc, int num)
+bool
+async_dispatch()
 {
-	dc->x += num;
+	xcb_generic_error_t *error;
+	async_t *async;
+	void *reply;
+	bool update = false;
+
+	while (!list_empty(&async_xcbs)) {
+		async = list_entry(async_xcbs.next, async_t, head);
+		if (!xcb_poll_for_reply(bar.xcb, async->sequence, &reply, &error))
+			break;
+		free(error);
+		if (async_finish(async, reply, false))
+			update = true;
+	}
+	return update;
 }
 
 /**
- * draw_color_text() - render text with color.
- * @dc: DC.
- * @color: rendering text color.
- * @str: rendering text.
+ * async_reap() - free fd requests finished in the poll batch.
  */
 void
-draw_color_text(draw_context_t *dc, color_t *color, const char *str)
+async_reap()
 {
-	int width;
-	size_t nglyph = load_glyphs(dc, str, glyph_caches, sizeof(glyph_caches), &width);
-	dc_calc_render_pos(dc, glyph_caches, nglyph);
-	draw_glyphs(dc, color, glyph_caches, nglyph);
-	dc_move_x(dc, width);
+	list_head *pos, *tmp;
+
+	list_for_each_safe(&async_dead, pos, tmp) {
+		list_del(pos);
+		free(list_entry(pos, async_t, head));
+	}
 }
 
 /**
- * draw_glyphs() - draw text use loaded glyphs.
- * @dc: draw context.
- * @color: foreground color.
- * @specs: loaded glyphs.
- * @len: max length of specs.
+ * async_destroy() - time out all requests.
+ *
+ * Continuations are called as timed out, so they free their data. This
+ * must be called before resources used by continuations are freed.
  */
 void
-draw_glyphs(draw_context_t *dc, color_t *color, const glyph_font_spec_t *specs, int len)
+async_destroy()
 {
-	cairo_font_face_t *prev = NULL;
-	int i;
+	async_t *async;
 
-	cairo_set_font_options(dc->cr, bar.font_opt);
-	cairo_set_font_size(dc->cr, bar.font_size);
-	cairo_set_source_rgb(dc->cr, CONVCOL(color->red), CONVCOL(color->green), CONVCOL(color->blue));
-	for (i = 0; i < len; i++) {
-		if (prev != specs[i].font->cairo) {
-			prev = specs[i].font->cairo;
-			cairo_set_font_face(dc->cr, prev);
-		}
-		cairo_show_glyphs(dc->cr, (cairo_glyph_t *)&specs[i].glyph, 1);
+	while (!list_empty(&async_xcbs)) {
+		async = list_entry(async_xcbs.next, async_t, head);
+		xcb_discard_reply(bar.xcb, async->sequence);
+		async_finish(async, NULL, true);
 	}
+	while (!list_empty(&async_fds))
+		async_finish(list_entry(async_fds.next, async_t, head), NULL, true);
+	async_reap();
 }
 
 /**
- * draw_text() - render text.
- * @dc: draw context.
- * @str: rendering text.
+ * module_state() - get the sampled state of the module.
+ * @opts: module options.
+ * @sampler: sampler of the module.
+ *
+ * The sampler is registered to the scheduler and sampled on first call,
+ * then it is sampled every interval of the module, or the interval of the
+ * sampler if the module does not specify it.
+ *
+ * Offloaded samplers are sampled on the worker pool, so the state stays
+ * zero filled until the first sample arrives.
+ *
+ * Samplers are registered by the first frame, which is rendered on the
+ * event thread before the render thread is started.
+ *
+ * Return: the last published state of sampler->size bytes, which must not
+ *         be modified.
  */
-void
-draw_text(draw_context_t *dc, const char *str)
+void *
+module_state(module_option_t *opts, const module_sampler_t *sampler)
 {
-	draw_color_text(dc, bar.fg, str);
+	module_sched_t *sched;
+
+	if ((sched = opts->any.sched))
+		return snapshot_get(&sched->shown);
+
+	sched = calloc(1, sizeof(module_sched_t));
+	sched->opts = opts;
+	sched->sampler = sampler;
+	sched->state = calloc(1, sampler->size);
+	sched->timer.func = module_sched_fire;
+	list_head_init(&sched->timer.head);
+	list_add_tail(&scheds, &sched->head);
+	opts->any.sched = sched;
+
+	if (sampler->offload && !sched_wq && (sched_wq = workqueue_new(SAMPLER_THREADS))) {
+		sched_pollfd.fd = workqueue_fd(sched_wq);
+		sched_pollfd.deinit = module_sched_stop;
+		sched_pollfd.handler = module_sched_complete;
+		sched_pollfd.name = "samplers";
+		poll_add(&sched_pollfd);
+	}
+	if (sampler->offload && sched_wq)
+		sched->sample = module_sched_sample_new(sched);
+
+	module_sched_publish(sched);
+	module_sched_sample(sched);
+	module_sched_arm(sched);
+
+	return snapshot_get(&sched->shown);
 }
 
 /**
- * draw_bargraph() - render bar graph.
- * @dc: draw context.
- * @label: label of the graph.
- * @items: items of the Graph.
- * @nitem: number of items.
+ * module_refresh() - sample the state of the module immediately.
+ * @opts: module options.
+ *
+ * Event handlers call this after changing what the module shows.
  */
 void
-draw_bargraph(draw_context_t *dc, const char *label, graph_item_t *items, int nitem)
+module_refresh(module_option_t *opts)
 {
-	xcb_rectangle_t rect = { 0 };
-
-	int width = (celwidth + 1) * nitem;
-	draw_color_text(dc, bar.fg, label);
-	int x = dc_get_x(dc) + celwidth;
-	for (int i = 0; i < nitem; i++) {
-		xcb_gc_color(bar.xcb, dc->gc, items[i].bg);
-		rect.x = x - celwidth;
-		rect.y = graph_basey;
-		rect.width = celwidth;
-		rect.height = graph_maxh;
-		xcb_poly_fill_rectangle(bar.xcb, dc->tmp->pixmap, dc->gc, 1, &rect);
-
-		if (items[i].val < 0)
-			goto CONTINUE;
+	module_sched_t *sched = opts->any.sched;
 
-		xcb_gc_color(bar.xcb, dc->gc, items[i].fg);
-		rect.width = celwidth;
-		rect.height = SMALLER(BIGGER(graph_maxh * items[i].val, 1), graph_maxh);;
-		rect.x = x - celwidth;
-		rect.y = graph_basey + (graph_maxh - rect.height);
-		xcb_poly_fill_rectangle(bar.xcb, dc->tmp->pixmap, dc->gc, 1, &rect);
-	CONTINUE:
-		x += celwidth + 1;
+	if (!sched)
+		return;
+	if (sched->busy || atomic_load(&sched->stale)) {
+		sched->again = true;
+		return;
 	}
-	dc_move_x(dc, width);
+	sched->refresh = true;
+	module_sched_sample(sched);
+	module_sched_arm(sched);
 }
 
 /**
- * text() - render the specified text.
- * @dc: draw context.
+ * module_predict() - show the state expected after a change to the device.
  * @opts: module options.
+ * @state: predicted state of sampler->size bytes.
+ *
+ * The predicted state is shown until the next module_refresh(), whose sample
+ * is published even if it has not been changed. Periodic samples replace it
+ * only if the device has been changed by others.
  */
 void
-text(draw_context_t *dc, module_option_t *opts)
+module_predict(module_option_t *opts, const void *state)
 {
-	color_t *fg = bar.fg;
-	if (opts->text.fg)
-		fg = color_load(opts->text.fg);
-	draw_color_text(dc, fg, opts->text.label);
+	module_sched_t *sched = opts->any.sched;
+	void *copy;
+
+	if (!sched)
+		return;
+	copy = malloc(sched->sampler->size);
+	memcpy(copy, state, sched->sampler->size);
+	snapshot_publish(&sched->shown, copy, free);
+	sched->predicted = true;
+	render_request(opts);
 }
 
 /**
- * render_labels() - render all labels
- * @dc: DC.
- * @labels: label_t array.
- * @nlabel: length of labels.
+ * module_scroll() - accumulate a scroll wheel step of the module.
+ * @opts: module options.
+ * @step: 1 for up, -1 for down.
+ * @apply: function to apply the net steps to the device.
+ *
+ * Steps made within SCROLL_DELAY from the first one are applied at once on
+ * the event thread, so a fast scroll writes to the device once. Modules show
+ * the predicted value meanwhile.
+ *
+ * Return: the net steps waiting to be applied, including step.
  */
-void
-render_labels(draw_context_t *dc, label_t *labels, size_t nlabel)
+int
+module_scroll(module_option_t *opts, int step, scroll_apply_t apply)
 {
-	size_t i;
-	int x = 0;
-
-	for (i = 0; i < nlabel; i++) {
-		if (!labels[i].option->any.func)
-			continue;
-
-		x = dc_get_x(dc);
+	list_head *pos;
+	scroll_t *scroll = NULL;
 
-		draw_padding(dc, celwidth);
-		labels[i].option->any.func(dc, labels[i].option);
-		draw_padding(dc, celwidth);
-		labels[i].width = dc_get_x(dc) - x;
-		labels[i].x = x;
-		if (labels[i].width == celwidth * 2) {
-			dc->x = x;
-			labels[i].width = 0;
-			continue;
-		}
-		dc->width += labels[i].width;
+	list_for_each(&scrolls, pos) {
+		scroll = list_entry(pos, scroll_t, head);
+		if (scroll->opts == opts)
+			break;
+		scroll = NULL;
+	}
+	if (!scroll) {
+		scroll = calloc(1, sizeof(scroll_t));
+		scroll->opts = opts;
+		scroll->timer.func = scroll_fire;
+		list_head_init(&scroll->timer.head);
+		list_add_tail(&scrolls, &scroll->head);
 	}
+	if (list_empty(&scroll->timer.head))
+		timer_add(wheel, &scroll->timer, timer_now() + SCROLL_DELAY);
+	scroll->apply = apply;
+	scroll->steps += step;
+	nscroll++;
+	return scroll->steps;
 }
 
 /**
- * xcb_gc_color() - set foreground color to xcb_gcontext_t
- * @xcb: xcb connection.
- * @gc: xcb_gcontext_t
- * @color: foreground color.
+ * scroll_fire() - timer function applying accumulated steps.
+ * @timer: timer_entry_t of scroll_t
  */
 void
-xcb_gc_color(xcb_connection_t *xcb, xcb_gcontext_t gc, color_t *color)
+scroll_fire(timer_entry_t *timer)
 {
-	xcb_change_gc_value_list_t values = { .foreground = color->pixel };
-	xcb_change_gc_aux(xcb, gc, XCB_GC_FOREGROUND, &values);
+	scroll_t *scroll = list_entry(timer, scroll_t, timer);
+	int steps = scroll->steps;
+
+	scroll->steps = 0;
+	if (!steps)
+		return;
+	nscrollapply++;
+	scroll->apply(scroll->opts, steps);
 }
 
 /**
- * calculate_systray_item_positions() - calculate position of tray items.
- * @label: the label must has been made from systray module.
- * @opts: module option.
+ * scroll_destroy() - drop steps not applied yet.
  */
 void
-calculate_systray_item_positions(label_t *label, module_option_t *opts)
+scroll_destroy()
 {
-	xcb_configure_window_value_list_t values;
-	uint32_t mask = XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y | XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT;
-	systray_item_t *item;
-	list_head *pos;
-	int x;
-
-	if (!systray_icon_size(tray))
-		systray_set_icon_size(tray, opts->tray.iconsize);
-
-	if (list_empty(systray_get_items(tray)))
-		return;
+	list_head *pos, *tmp;
+	scroll_t *scroll;
 
-	/* fix the position for padding */
-	x = label->x + celwidth;
-	list_for_each(systray_get_items(tray), pos) {
-		item = list_entry(pos, systray_item_t, head);
-		if (!item->info.flags)
-			continue;
-		if (item->x != x) {
-			values.x = x;
-			values.y = (BAR_HEIGHT - opts->tray.iconsize) / 2;
-			values.width = opts->tray.iconsize;
-			values.height = opts->tray.iconsize;
-			if (!xcb_request_check(bar.xcb, xcb_configure_window_aux(bar.xcb, item->win, mask, &values)))
-				item->x = x;
-			if (!item->mapped)
-				item->mapped = xcb_request_check(bar.xcb, xcb_map_window(bar.xcb, item->win)) == NULL;
-		}
-		x += opts->tray.iconsize + celwidth;
+	list_for_each_safe(&scrolls, pos, tmp) {
+		scroll = list_entry(pos, scroll_t, head);
+		timer_del(&scroll->timer);
+		free(scroll);
 	}
+	list_head_init(&scrolls);
 }
 
 /**
- * calculate_label_positions() - calculate position of labels.
- * @dc: draw_context_t
- * @labels: label_t array.
- * @nlabel: length of labels.
- * @offset: position offset.
+ * module_sched_publish() - publish a copy of the state for the render thread.
+ * @sched: module_sched_t
  */
 void
-calculate_label_positions(draw_context_t *dc, label_t *labels, size_t nlabel, int offset)
+module_sched_publish(module_sched_t *sched)
 {
-	size_t i;
-	for (i = 0; i < nlabel; i++) {
-		labels[i].x += offset;
+	void *copy = malloc(sched->sampler->size);
 
-		if (systray_get_window(tray) == dc->xbar.win && labels[i].option->any.func == systray)
-			calculate_systray_item_positions(&labels[i], labels[i].option);
-	}
+	memcpy(copy, sched->state, sched->sampler->size);
+	snapshot_publish(&sched->shown, copy, free);
+	sched->predicted = false;
 }
 
 /**
- * render() - rendering all modules.
+ * module_stale() - check the module shows the state before an abandoned sample.
+ * @opts: module options.
+ *
+ * Frames draw labels of such modules with STALEFGCOLOR.
+ *
+ * Return: bool
  */
-void
-render()
+bool
+module_stale(module_option_t *opts)
 {
-	draw_context_t *dc;
-	window_t *xw;
-	xcb_rectangle_t rect = { 0 };
-	int i;
-
-	for (i = 0; i < bar.ndc; i++) {
-		dc = &bar.dcs[i];
-		xw = &dc->xbar;
-		rect.width = xw->width;
-		rect.height = xw->height;
-
-		xcb_gc_color(bar.xcb, dc->gc, bar.bg);
-		xcb_poly_fill_rectangle(bar.xcb, dc->buf->pixmap, dc->gc, 1, &rect);
-
-		/* render left modules */
-		xcb_poly_fill_rectangle(bar.xcb, dc->tmp->pixmap, dc->gc, 1, &rect);
-		dc->x = dc->width = 0;
-		render_labels(dc, dc->left_labels, LENGTH(left_modules));
-		xcb_copy_area(bar.xcb, dc->tmp->pixmap, dc->buf->pixmap, dc->gc, 0, 0, celwidth, 0, dc->width, xw->height);
-		calculate_label_positions(dc, dc->left_labels, LENGTH(left_modules), celwidth);
-
-		/* render right modules */
-		xcb_poly_fill_rectangle(bar.xcb, dc->tmp->pixmap, dc->gc, 1, &rect);
-		dc->x = dc->width = 0;
-		render_labels(dc, dc->right_labels, LENGTH(right_modules));
-		xcb_copy_area(bar.xcb, dc->tmp->pixmap, dc->buf->pixmap, dc->gc, 0, 0, xw->width - dc->width - celwidth, 0, dc->width, xw->height);
-		calculate_label_positions(dc, dc->right_labels, LENGTH(right_modules), xw->width - dc->width - celwidth);
+	return opts->any.sched && atomic_load(&opts->any.sched->stale);
+}
 
-		/* copy pixmap to window */
-		xcb_copy_area(bar.xcb, dc->buf->pixmap, xw->win, dc->gc, 0, 0, 0, 0, xw->width, xw->height);
-	}
-	xcb_flush(bar.xcb);
+/**
+ * module_sched_sample_new() - allocate a sample of the offloaded sampler.
+ * @sched: module_sched_t
+ *
+ * Return: sched_sample_t *
+ */
+sched_sample_t *
+module_sched_sample_new(module_sched_t *sched)
+{
+	sched_sample_t *sample = calloc(1, sizeof(sched_sample_t));
+
+	sample->work.func = module_sched_work;
+	sample->work.done = module_sched_done;
+	sample->opts = sched->opts;
+	sample->sampler = sched->sampler;
+	sample->sched = sched;
+	sample->next = calloc(1, sched->sampler->size);
+	return sample;
 }
 
 /**
- * bspwmbar_init() - initialize bspwmbar.
- * @dpy: display pointer.
- * @scr: screen number.
+ * module_sched_sample() - sample the module now or on the worker pool.
+ * @sched: module_sched_t
  *
- * Return:
- * 0 - success
- * 1 - failure
+ * A sampler has at most one sample in flight. A sample overrunning
+ * SAMPLER_TIMEOUT is abandoned by module_sched_abandon(), and the sampler is
+ * not sampled again until the abandoned sample returns.
  */
-bool
-bspwmbar_init(xcb_connection_t *xcb, xcb_screen_t *scr)
+void
+module_sched_sample(module_sched_t *sched)
 {
-	xcb_randr_get_monitors_reply_t *mon_reply;
-	xcb_randr_get_screen_resources_reply_t *screen_reply;
-	xcb_randr_get_output_info_reply_t *info_reply;
-	xcb_randr_output_t *outputs;
-	xcb_randr_get_crtc_info_reply_t *crtc_reply;
-	int i, nmon = 0;
+	sched_sample_t *sample = sched->sample;
+	uint64_t now;
 
-	/* initialize */
-	bar.xcb = xcb;
-	bar.scr = scr;
-	bar.cmap = scr->default_colormap;
-	bar.fg = color_load(FGCOLOR);
-	bar.bg = color_load(BGCOLOR);
+	if (sched->reset && !sched->busy && !atomic_load(&sched->stale)) {
+		if (sched->sampler->reset)
+			sched->sampler->reset(sched->opts, sched->state);
+		sched->reset = false;
+	}
+	if (!sample) {
+		if (sched->sampler->update(sched->opts, sched->state) || (sched->predicted && sched->refresh)) {
+			module_sched_publish(sched);
+			sched_changed = true;
+		}
+		sched->refresh = false;
+		return;
+	}
 
-	/* get monitors */
-	mon_reply = xcb_randr_get_monitors_reply(xcb, xcb_randr_get_monitors(xcb, scr->root, 1), NULL);
-	bar.dcs = (draw_context_t *)calloc(mon_reply->nMonitors, sizeof(draw_context_t));
-	bar.ndc = mon_reply->nMonitors;
+	now = timer_now();
+	if (sched->busy || atomic_load(&sched->stale)) {
+		noverrun++;
+		if (sched->busy && now - sched->started >= SAMPLER_TIMEOUT)
+			module_sched_abandon(sched);
+		return;
+	}
 
-	/* create window per monitor */
-	screen_reply = xcb_randr_get_screen_resources_reply(xcb, xcb_randr_get_screen_resources(xcb, scr->root), NULL);
-	outputs = xcb_randr_get_screen_resources_outputs(screen_reply);
-	for (i = 0; i < screen_reply->num_outputs; i++) {
-		info_reply = xcb_randr_get_output_info_reply(xcb, xcb_randr_get_output_info(xcb, outputs[i], XCB_TIME_CURRENT_TIME), NULL);
-		if (info_reply->crtc != XCB_NONE) {
-			crtc_reply = xcb_randr_get_crtc_info_reply(xcb, xcb_randr_get_crtc_info(xcb, info_reply->crtc, XCB_TIME_CURRENT_TIME), NULL);
-			if (dc_init(&bar.dcs[nmon], xcb, scr, crtc_reply->x, crtc_reply->y, crtc_reply->width, BAR_HEIGHT))
-				strncpy(bar.dcs[nmon++].monitor_name, (const char *)xcb_randr_get_output_info_name(info_reply), SMALLER(xcb_randr_get_output_info_name_length(info_reply), NAME_MAXSZ));
-			free(crtc_reply);
+	memcpy(sample->next, sched->state, sched->sampler->size);
+	sched->busy = true;
+	sched->started = now;
+	/* files of due samplers are read in one batch */
+	if (sched_batching && collect_owns(sched->opts)) {
+		if (npending >= pendingcap) {
+			pendingcap += 8;
+			sched_pending = realloc(sched_pending, pendingcap * sizeof(module_sched_t *));
 		}
-		free(info_reply);
+		sched_pending[npending++] = sched;
+		return;
 	}
-	free(screen_reply);
-	free(mon_reply);
+	sample->queued = &sample->work;
+	if (!workqueue_push(sched_wq, &sample->work)) {
+		sched->busy = false;
+		return;
+	}
+	noffload++;
+}
 
-	if (!nmon)
-		return false;
+/**
+ * module_sched_abandon() - give up the sample overrunning SAMPLER_TIMEOUT.
+ * @sched: module_sched_t
+ *
+ * The blocked worker keeps the sample with its next state and is replaced
+ * in the pool, and the sampler gets a new sample. The module is shown as
+ * stale until the abandoned sample returns, which is then published.
+ * Samples still waiting in the queue are left to the workers.
+ */
+void
+module_sched_abandon(module_sched_t *sched)
+{
+	sched_sample_t *sample = sched->sample;
 
-	/* load_fonts */
-	if (!load_fonts(fontname))
-		return false;
+	if (!workqueue_abandon(sched_wq, sample->queued))
+		return;
 
-	xcb_flush(xcb);
-	return true;
+	err("sampler: abandoned a sample running for %lu ms\n",
+	    (unsigned long)(timer_now() - sched->started));
+	ntimeout++;
+	sample->abandoned = true;
+	sched->sample = module_sched_sample_new(sched);
+	sched->busy = false;
+	atomic_store(&sched->stale, true);
+	render_request(sched->opts);
 }
 
 /**
- * font_destroy() - free all resources of font.
- * @font: font_t
+ * module_sched_work() - sample the module on a worker thread.
+ * @work: work_t of sched_sample_t
+ *
+ * The update only touches the sample, which is not read by the main thread
+ * while it is in flight.
  */
 void
-font_destroy(font_t font)
+module_sched_work(work_t *work)
 {
-	cairo_font_face_destroy(font.cairo);
-	hb_font_destroy(font.hb);
-	FT_Done_Face(font.face);
+	sched_sample_t *sample = list_entry(work, sched_sample_t, work);
+
+	sample->result = sample->sampler->update(sample->opts, sample->next);
 }
 
 /**
- * font_caches_destroy() - free all resources of font caches.
+ * module_sched_done() - publish the sample finished on the worker pool.
+ * @work: work_t of sched_sample_t
+ *
+ * An abandoned sample is published in the same way, since the sampler has
+ * not been sampled after it, and then it is freed.
  */
 void
-font_caches_destroy()
+module_sched_done(work_t *work)
 {
-	int i;
-	for (i = 0; i < nfcache; i++)
-		font_destroy(fcaches[i]);
-	nfcache = 0;
-	fcachecap = 0;
-	if (fcaches)
-		free(fcaches);
+	sched_sample_t *sample = list_entry(work, sched_sample_t, work);
+	module_sched_t *sched = sample->sched;
+	bool abandoned = sample->abandoned, changed;
+	void *state = sched->state;
+
+	sched->state = sample->next;
+	changed = sample->result || (sched->predicted && sched->refresh);
+	if (abandoned) {
+		free(state);
+		free(sample);
+		atomic_store(&sched->stale, false);
+	} else {
+		sample->next = state;
+		sched->busy = false;
+	}
+
+	if (changed)
+		module_sched_publish(sched);
+	/* stale labels are drawn again as soon as the sample returns */
+	if (abandoned || (changed && sched->refresh))
+		render_request(sched->opts);
+	else if (changed)
+		sched_changed = true;
+	sched->refresh = false;
+
+	if (sched->again) {
+		sched->again = false;
+		module_refresh(sched->opts);
+	}
 }
 
 /**
- * bspwmbar_destroy() - destroy all resources of bspwmbar.
+ * module_sched_flush() - queue samplers due at the tick as one batch.
  */
 void
-bspwmbar_destroy()
+module_sched_flush()
 {
-	list_head *cur;
+	sched_sample_t *sample;
+	sched_batch_t *batch;
 	int i;
-	list_head *pos;
-
-	list_for_each(&pollfds, cur)
-		poll_del(list_entry(cur, poll_fd_t, head));
 
-	/* font resources */
-	cairo_font_options_destroy(bar.font_opt);
-	font_destroy(bar.font);
-	font_caches_destroy();
-	FcPatternDestroy(bar.pattern);
-
-	/* deinit modules */
-	list_for_each(&pollfds, pos)
-		poll_del(list_entry(pos, poll_fd_t, head));
-
-	/* rendering resources */
-	for (i = 0; i < bar.ndc; i++)
-		dc_free(bar.dcs[i]);
-	free(bar.dcs);
+	if (npending == 1) {
+		sample = sched_pending[0]->sample;
+		sample->queued = &sample->work;
+		if (workqueue_push(sched_wq, &sample->work))
+			noffload++;
+		else
+			sched_pending[0]->busy = false;
+	} else if (npending > 1) {
+		batch = malloc(sizeof(sched_batch_t) + npending * sizeof(sched_sample_t *));
+		batch->work.func = module_sched_batch_work;
+		batch->work.done = module_sched_batch_done;
+		batch->n = npending;
+		for (i = 0; i < npending; i++) {
+			batch->samples[i] = sched_pending[i]->sample;
+			batch->samples[i]->queued = &batch->work;
+		}
+		if (workqueue_push(sched_wq, &batch->work)) {
+			noffload += npending;
+		} else {
+			for (i = 0; i < npending; i++)
+				sched_pending[i]->busy = false;
+			free(batch);
+		}
+	}
+	npending = 0;
 }
 
 /**
- * systray() - render systray.
- * @dc: draw context.
- * @opts: dummy.
+ * module_sched_batch_work() - sample the batch on a worker thread.
+ * @work: work_t of sched_batch_t
  */
 void
-systray(draw_context_t *dc, module_option_t *opts)
+module_sched_batch_work(work_t *work)
 {
-	list_head *pos, *base;
-	(void)opts;
+	sched_batch_t *batch = (sched_batch_t *)work;
+	const void **owners = alloca(batch->n * sizeof(void *));
+	int i;
 
-	if (!systray_icon_size(tray))
-		systray_set_icon_size(tray, opts->tray.iconsize);
+	for (i = 0; i < batch->n; i++)
+		owners[i] = batch->samples[i]->opts;
+	collect_prefetch(owners, batch->n);
+	for (i = 0; i < batch->n; i++)
+		module_sched_work(&batch->samples[i]->work);
+}
 
-	if (list_empty(systray_get_items(tray)))
-		return;
+/**
+ * module_sched_batch_done() - publish samples of the batch.
+ * @work: work_t of sched_batch_t
+ */
+void
+module_sched_batch_done(work_t *work)
+{
+	sched_batch_t *batch = (sched_batch_t *)work;
+	int i;
 
-	if (systray_get_window(tray) != dc->xbar.win)
-		return;
+	for (i = 0; i < batch->n; i++)
+		module_sched_done(&batch->samples[i]->work);
+	free(batch);
+}
 
-	/* render spaces for iconsize */
-	base = systray_get_items(tray);
-	list_for_each(base, pos) {
-		systray_item_t *item = list_entry(pos, systray_item_t, head);
-		if (!item->info.flags)
-			continue;
-		draw_padding(dc, opts->tray.iconsize);
-		if (base != pos->next)
-			draw_padding(dc, celwidth);
-	}
+/**
+ * module_sched_complete() - PollUpdateHandler for the worker pool.
+ * @fd: fd of the worker pool.
+ *
+ * Changed states are rendered by poll_loop() with due samplers.
+ *
+ * Return: PR_NOOP
+ */
+poll_result_t
+module_sched_complete(int fd)
+{
+	(void)fd;
+	sched_pollfd.nevent += workqueue_complete(sched_wq);
+	return PR_NOOP;
 }
 
 /**
- * poll_stop() - stop polling to all file descriptor.
+ * module_sched_stop() - stop the worker pool.
+ *
+ * Return: 0
  */
-void
-poll_stop()
+int
+module_sched_stop()
 {
-	if (pfd > 0)
-		close(pfd);
+	workqueue_destroy(sched_wq);
+	sched_wq = NULL;
+	return 0;
 }
 
 /**
- * poll_add() - add the file descriptor to polling targets.
- * @pollfd: PollFD object.
+ * module_sched_arm() - schedule the next sampling.
+ * @sched: module_sched_t
+ *
+ * Deadlines are rounded to wall clock multiples of TIMER_SLACK, or of the
+ * interval for aligned samplers, so samplers with related intervals share
+ * wakeups.
  */
 void
-poll_add(poll_fd_t *pollfd)
+module_sched_arm(module_sched_t *sched)
 {
-	(void)pollfd;
-#if defined(__linux)
-	struct epoll_event ev;
+	unsigned int interval = sched->opts->any.interval, unit;
+	uint64_t now = timer_now(), real, expire;
+	struct timespec ts;
 
-	ev.events = EPOLLIN;
-	ev.data.fd = pollfd->fd;
-	ev.data.ptr = (void *)pollfd;
+	if (!interval)
+		interval = sched->sampler->interval;
+	if (!interval)
+		return;
 
-	if (epoll_ctl(pfd, EPOLL_CTL_ADD, pollfd->fd, &ev) == -1)
-		die("epoll_ctl(): failed to add to epoll\n");
-#elif defined(__OpenBSD__) || defined(__FreeBSD__)
-	struct kevent ev = { 0 };
+	clock_gettime(CLOCK_REALTIME, &ts);
+	real = (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+	unit = sched->sampler->align ? interval : SMALLER(TIMER_SLACK, interval);
+	if (!unit)
+		expire = real + interval;
+	else if (sched->sampler->align)
+		expire = (real / unit + 1) * unit;
+	else
+		expire = (real + interval + unit / 2) / unit * unit;
+	if (expire <= real)
+		expire += unit;
+	timer_add(wheel, &sched->timer, now + (expire - real));
+}
 
-	EV_SET(&ev, pollfd->fd, EVFILT_READ, EV_ADD, 0, 0, pollfd);
-	if (kevent(pfd, &ev, 1, NULL, 0, NULL) == -1)
-		die("EV_SET(): failed to add to kqueue\n");
-#endif
+/**
+ * module_sched_fire() - timer function of samplers.
+ * @timer: timer_entry_t of module_sched_t
+ */
+void
+module_sched_fire(timer_entry_t *timer)
+{
+	module_sched_t *sched = list_entry(timer, module_sched_t, timer);
 
-	list_add_tail(&pollfds, &pollfd->head);
+	module_sched_sample(sched);
+	module_sched_arm(sched);
 }
 
 /**
- * poll_del() - delete the file descriptor from polling targets.
- * @pollfd: PollFD object.
+ * module_sched_run() - sample due modules.
+ *
+ * Return: true if states of some modules have been changed.
+ */
+bool
+module_sched_run()
+{
+	bool changed;
+
+	sched_batching = sched_wq != NULL;
+	timer_wheel_run(wheel, timer_now());
+	sched_batching = false;
+	module_sched_flush();
+	changed = sched_changed;
+	sched_changed = false;
+	return changed;
+}
+
+/**
+ * module_sched_destroy() - free all samplers.
  */
 void
-poll_del(poll_fd_t *pollfd)
+module_sched_destroy()
 {
-	if (pollfd->deinit)
-		pollfd->deinit();
-	if (pollfd->fd) {
-#if defined(__linux)
-		epoll_ctl(pfd, EPOLL_CTL_DEL, pollfd->fd, NULL);
-#elif defined(__OpenBSD__) || defined(__FreeBSD__)
-		struct kevent ev = { 0 };
-		EV_SET(&ev, pollfd->fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
-		kevent(pfd, &ev, 1, NULL, 0, NULL);
-#endif
+	list_head *pos, *tmp;
+	module_sched_t *sched;
+	bool busy = false;
+
+	if (!wheel)
+		return;
+	list_for_each_safe(&scheds, pos, tmp) {
+		sched = list_entry(pos, module_sched_t, head);
+		sched->opts->any.sched = NULL;
+		snapshot_publish(&sched->shown, NULL, free);
+		/* a blocked worker still owns the sample in flight */
+		if (sched->busy || atomic_load(&sched->stale)) {
+			busy = true;
+			continue;
+		}
+		free(sched->state);
+		if (sched->sample) {
+			free(sched->sample->next);
+			free(sched->sample);
+		}
+		free(sched);
 	}
-	list_del(&pollfd->head);
+	list_head_init(&scheds);
+	free(sched_pending);
+	sched_pending = NULL;
+	pendingcap = 0;
+	if (!busy)
+		collect_destroy();
+	timer_wheel_destroy(wheel);
+	wheel = NULL;
 }
 
 /**
- * poll_init() - initialize poll.
+ * frame_ready() - check a pending frame can be rendered now.
  *
- * The function must be called before poll_add(), poll_del().
+ * The first frame after idle is rendered immediately, following ones wait
+ * until FRAME_INTERVAL has passed since the last frame.
+ *
+ * Return: bool
  */
-void
-poll_init()
+bool
+frame_ready()
 {
-	list_head_init(&pollfds);
+	uint64_t now;
+
+	if (!frame_dirty)
+		return false;
+	now = timer_now();
+	if (frame_last && now < frame_last + FRAME_INTERVAL)
+		return false;
+	frame_dirty = false;
+	frame_last = now;
+	return true;
 }
 
-#if defined(__linux)
 /**
- * timer_reset() - PollUpdateHandler for timer.
- * @fd: timerfd.
+ * poll_deadline() - get the time of the next wakeup.
  *
- * Return: PollResult
+ * Return: milliseconds of timer_now() or -1 if nothing is pending.
+ */
+int64_t
+poll_deadline()
+{
+	int64_t deadline = timer_wheel_next(wheel), frame;
+
+	if (frame_dirty) {
+		frame = frame_last + FRAME_INTERVAL;
+		if (deadline < 0 || frame < deadline)
+			deadline = frame;
+	}
+	return deadline;
+}
+
+/**
+ * wakeup_count() - count a wakeup of the poll loop.
  *
- * always - PR_UPDATE
+ * wakeups_per_min holds the number of wakeups in the last full minute.
  */
-poll_result_t
-timer_reset(int fd)
+void
+wakeup_count()
 {
-	uint64_t tcnt;
-	if (read(fd, &tcnt, sizeof(uint64_t)) < 0)
-		return PR_FAILED;
-	return PR_UPDATE;
+	uint64_t now = timer_now();
+
+	nwakeup++;
+	if (now >= wakeup_window + 60000) {
+		/* no wakeups in the previous minute if it has been skipped */
+		wakeups_per_min = (now < wakeup_window + 120000) ? nwakeup_window : 0;
+		wakeup_window = now;
+		nwakeup_window = 0;
+	}
+	nwakeup_window++;
 }
 
-#endif
 /**
  * is_change_active_window_event() - check the event is change active window.
  *
@@ -1483,41 +5102,67 @@ is_change_active_window_event(xcb_property_notify_event_t *ev)
 	return (ev->window == bar.scr->root) && (ev->atom == ewmh._NET_ACTIVE_WINDOW);
 }
 
-poll_result_t
+/**
+ * xcb_event_notify() - notify the button event to the clicked module.
+ * @event: xcb_generic_event_t
+ * @dc: draw_context_t of the clicked bar.
+ *
+ * The label of the module is re-rendered by the render thread ahead of
+ * the frame interval. Labels are hit by positions of the presented frame.
+ */
+void
 xcb_event_notify(xcb_generic_event_t *event, draw_context_t *dc)
 {
-	size_t i;
 	xcb_button_press_event_t *button = (xcb_button_press_event_t *)event;
-	for (i = 0; i < LENGTH(left_modules); i++) {
-		module_option_t *opt = dc->left_labels[i].option;
-		if (!opt->any.handler)
-			continue;
-		if (IS_LABEL_EVENT(dc->left_labels[i], button)) {
-			opt->any.handler(event, opt);
-			return PR_UPDATE;
-		}
-	}
-	for (i = 0; i < LENGTH(right_modules); i++) {
-		module_option_t *opt = dc->right_labels[i].option;
-		if (!opt->any.handler)
-			continue;
-		if (IS_LABEL_EVENT(dc->right_labels[i], button)) {
-			opt->any.handler(event, opt);
-			return PR_UPDATE;
-		}
-	}
-	return PR_NOOP;
+	module_option_t *opt = NULL;
+	bool changed = sched_changed;
+	size_t i;
+
+	pthread_mutex_lock(&renderer.lock);
+	for (i = 0; !opt && i < dc->nleft; i++)
+		if (dc->left_labels[i].option->any.handler && IS_LABEL_EVENT(dc->left_labels[i], button))
+			opt = dc->left_labels[i].option;
+	for (i = 0; !opt && i < dc->nright; i++)
+		if (dc->right_labels[i].option->any.handler && IS_LABEL_EVENT(dc->right_labels[i], button))
+			opt = dc->right_labels[i].option;
+	pthread_mutex_unlock(&renderer.lock);
+	if (!opt)
+		return;
+
+	opt->any.handler(event, opt);
+	/* offloaded samples are presented when they arrive */
+	if (opt->any.sched && opt->any.sched->busy)
+		return;
+	render_request(opt);
+	/* the refreshed state is presented by the request */
+	sched_changed = changed;
+}
+
+/**
+ * xev_handle() - PollUpdateHandler for the X connection.
+ *
+ * Return: poll_result_t of xev_dispatch().
+ */
+poll_result_t
+xev_handle()
+{
+	return xev_dispatch(true);
 }
 
 /**
- * xev_handle() - X11 event handling
+ * xev_dispatch() - X11 event handling
+ * @fetch: read the connection, otherwise only queued events are handled.
+ *
+ * All queued events are handled, and the window title is requested once for
+ * all property changes of the batch. Continuations of arrived replies are
+ * called after the events.
  *
  * Return: poll_result_t
  * PR_NOOP   - success and not need more action
  * PR_UPDATE - success and need rerendering
  */
 poll_result_t
-xev_handle()
+xev_dispatch(bool fetch)
 {
 	xcb_generic_event_t *event;
 	xcb_button_press_event_t *button;
@@ -1525,16 +5170,17 @@ xev_handle()
 	xcb_window_t win;
 	poll_result_t res = PR_NOOP;
 	draw_context_t *dc;
-
-	xcb_change_window_attributes_value_list_t attrs;
-	uint32_t mask = XCB_CW_EVENT_MASK;
-	attrs.event_mask = XCB_EVENT_MASK_PROPERTY_CHANGE;
+	bool title = false;
 
 	/* for X11 events */
-	while ((event = xcb_poll_for_event(bar.xcb))) {
+	while ((event = fetch ? xcb_poll_for_event(bar.xcb) : xcb_poll_for_queued_event(bar.xcb))) {
+		xfd.nevent++;
 		switch (event->response_type & ~0x80) {
 		case XCB_SELECTION_CLEAR:
+			/* the systray is read by frames */
+			render_lock();
 			systray_handle(tray, event);
+			render_unlock();
 			break;
 		case XCB_EXPOSE:
 			res = PR_UPDATE;
@@ -1553,32 +5199,38 @@ xev_handle()
 		case XCB_PROPERTY_NOTIFY:
 			prop = (xcb_property_notify_event_t *)event;
 			if (prop->atom == xembed_info) {
+				/* items are updated by the continuation */
 				systray_handle(tray, event);
-				res = PR_UPDATE;
-			} else if (is_change_active_window_event(prop) || prop->atom == ewmh._NET_WM_NAME) {
-				windowtitle_update(bar.xcb, 0);
-				res = PR_UPDATE;
+			} else if (is_change_active_window_event(prop) || prop->atom == ewmh._NET_WM_NAME ||
+			           prop->atom == XCB_ATOM_WM_NAME) {
+				title = true;
 			}
-			if (is_change_active_window_event(prop) && (win = get_active_window(0)))
-				xcb_change_window_attributes_aux(bar.xcb, win, mask, &attrs);
 			break;
 		case XCB_CLIENT_MESSAGE:
+			/* docked windows are appended by the continuation */
 			systray_handle(tray, event);
-			res = PR_UPDATE;
 			break;
 		case XCB_UNMAP_NOTIFY:
 			win = ((xcb_unmap_notify_event_t *)event)->event;
+			render_lock();
 			systray_remove_item(tray, win);
+			render_unlock();
 			res = PR_UPDATE;
 			break;
 		case XCB_DESTROY_NOTIFY:
 			win = ((xcb_destroy_notify_event_t *)event)->event;
+			render_lock();
 			systray_remove_item(tray, win);
+			render_unlock();
 			res = PR_UPDATE;
 			break;
 		}
 		free(event);
 	}
+	if (title)
+		windowtitle_request();
+	if (async_dispatch())
+		res = PR_UPDATE;
 	return res;
 }
 
@@ -1602,76 +5254,220 @@ epoll_wait_ignore_eintr(int pfd, struct epoll_event *events, int maxevents, int
                return 0;
        return -1;
 }
+#elif defined(__OpenBSD__) || defined(__FreeBSD__)
+/*
+ * kevent_ignore_eintr()
+ *
+ * kevent() wrapper to ignore EINTR errno
+ */
+int
+kevent_ignore_eintr(int kq, struct kevent *events, int nevents, const struct timespec *timeout)
+{
+	int nfd;
+	errno = 0;
+	nfd = kevent(kq, NULL, 0, events, nevents, timeout);
+	if (nfd != -1)
+		return nfd;
+	if (errno == EINTR)
+		return 0;
+	return -1;
+}
 #endif
 
 /*
  * poll_loop() - polling loop
  * @handler: rendering function
+ *
+ * The first frame is rendered in place to register modules, and following
+ * frames are handed off to the render thread.
  */
 void
 poll_loop(void (* handler)())
 {
 	int i, nfd, need_render;
 	poll_fd_t *pollfd;
+	poll_event_t ev;
 
 #if defined(__linux)
-	/* timer for rendering at one sec interval */
-	struct itimerspec interval = { {1, 0}, {1, 0} };
-	/* initialize timer */
-	int tfd = timerfd_create(CLOCK_REALTIME, 0);
-	timerfd_settime(tfd, 0, &interval, NULL);
+	/* timer for the next sampling of modules or the pending frame */
+	int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
 
 	timer.fd = tfd;
 	timer.handler = timer_reset;
+	timer.name = "timer";
 	poll_add(&timer);
+
+	/* steps of the wall clock and resume */
+	clockfd.fd = clock_watch();
+	clockfd.init = clock_watch;
+	clockfd.deinit = clock_unwatch;
+	clockfd.handler = clock_update;
+	clockfd.name = "clock";
+	poll_add(&clockfd);
 #endif
+	clock_check(false);
+
+	/* the title is requested on property changes after this */
+	windowtitle_request();
 
 	/* polling X11 event for modules */
 	xfd.fd = xcb_get_file_descriptor(bar.xcb);
 	xfd.handler = xev_handle;
+	xfd.name = "x11";
 	poll_add(&xfd);
 
+	renderer.render = handler;
+	font_worker_start();
+	render_request(NULL);
+	frame_last = timer_now();
+	render_thread_start();
+
 	/* polling fd */
 #if defined(__linux)
+	timer_arm(tfd, poll_deadline());
 	while ((nfd = epoll_wait_ignore_eintr(pfd, events, MAX_EVENTS, -1)) != -1) {
 		need_render = 0;
 #elif defined(__OpenBSD__) || defined(__FreeBSD__)
-	struct timespec tspec = { 0 };
-	tspec.tv_sec = 1;
-	while ((nfd = kevent(pfd, NULL, 0, events, MAX_EVENTS, &tspec)) != -1) {
+	struct timespec tspec = { 0 }, *tsp;
+	int64_t deadline, timeout;
+	for (;;) {
+		tsp = NULL;
+		if ((deadline = poll_deadline()) >= 0) {
+			timeout = BIGGER(deadline - (int64_t)timer_now(), 0);
+			tspec.tv_sec = timeout / 1000;
+			tspec.tv_nsec = timeout % 1000 * 1000000;
+			tsp = &tspec;
+		}
+		if ((nfd = kevent_ignore_eintr(pfd, events, MAX_EVENTS, tsp)) == -1)
+			break;
 		need_render = 0;
-		if (!nfd)
-			need_render = 1;
 #endif
-		for (i = 0; i < nfd; i++) {
-#if defined(__linux)
-			pollfd = (poll_fd_t *)events[i].data.ptr;
-#elif defined(__OpenBSD__) || defined(__FreeBSD__)
-			pollfd = (poll_fd_t *)events[i].udata;
+		wakeup_count();
+#if defined(__OpenBSD__) || defined(__FreeBSD__)
+		/* kqueue has no notification of steps of the wall clock */
+		clock_check(false);
 #endif
+		/* handle input before other sources of the batch */
+		for (i = 1; i < nfd; i++) {
+			if (EVENT_POLLFD(events[i]) == &xfd) {
+				ev = events[0];
+				events[0] = events[i];
+				events[i] = ev;
+				break;
+			}
+		}
+		for (i = 0; i < nfd; i++) {
+			pollfd = EVENT_POLLFD(events[i]);
+			pollfd->nwakeup++;
 			switch ((int)pollfd->handler(pollfd->fd)) {
 			case PR_UPDATE:
 				need_render = 1;
 				break;
 			case PR_REINIT:
-				poll_del(pollfd);
-				pollfd->fd = pollfd->init();
-				poll_add(pollfd);
-				break;
 			case PR_FAILED:
-				poll_stop();
+				/* sources without init can not be restarted */
+				if (!poll_fail(pollfd))
+					poll_stop();
 				break;
 			}
 		}
+		async_reap();
+		/* sample due modules */
+		if (module_sched_run())
+			need_render = 1;
+		/* events and replies read from the connection by other threads */
+		if (xev_dispatch(false) == PR_UPDATE)
+			need_render = 1;
+		if (stats_requested) {
+			stats_requested = 0;
+			stats_dump();
+		}
 		if (need_render) {
+			if (frame_dirty)
+				ncoalesce++;
+			frame_dirty = true;
+		}
+		if (frame_ready())
+			render_request(NULL);
+		/* free states replaced while frames were in flight */
+		snapshot_reclaim();
+		/* requests of continuations are sent before sleeping */
+		xcb_flush(bar.xcb);
 #if defined(__linux)
-			/* force render after interval */
-			timerfd_settime(tfd, 0, &interval, NULL);
+		/* wake up at the next sampling or the pending frame */
+		timer_arm(tfd, poll_deadline());
 #endif
-			windowtitle_update(bar.xcb, 0);
-			handler();
-		}
 	}
+	render_thread_stop();
+}
+
+/**
+ * stats_dump() - print statistics of caches to stderr.
+ */
+void
+stats_dump()
+{
+	unsigned long total = run_cache.hits + run_cache.misses;
+	unsigned long size, fsize = 0, csize, ccsize = 0, *ncoverage;
+	collect_stats_t cstats;
+	snapshot_stats_t sstats;
+	poll_fd_t *pollfd;
+	list_head *pos;
+	int i;
+
+	/* caches are owned by the render thread */
+	pthread_mutex_lock(&renderer.frame);
+	err("glyph runs: %d cached, %lu hits, %lu misses (%.1f%% hit rate)\n",
+	    run_cache.nrun, run_cache.hits, run_cache.misses,
+	    total ? (double)run_cache.hits * 100 / total : 0);
+
+	/*
+	 * Caches of the bar charged to each font, and sizes of font files.
+	 * FreeType faces and cairo and harfbuzz objects are not measured.
+	 */
+	ncoverage = coverage_count();
+	for (i = 0; i < nfcache; i++) {
+		size = fcaches[i]->face->stream->size;
+		csize = font_cache_bytes(fcaches[i]) + ncoverage[i + 2] * sizeof(coverage_entry_t);
+		fsize += size;
+		ccsize += csize;
+		err("  font %s:%d: %lu KiB of caches, %lu KiB file, %ld glyphs, %d pinned, %lu frames ago\n",
+		    fcaches[i]->path, fcaches[i]->index, csize / 1024, size / 1024,
+		    fcaches[i]->face->num_glyphs, fcaches[i]->npin, nframe - fcaches[i]->used);
+	}
+	free(ncoverage);
+	err("fallback fonts: %d/%d loaded, %lu KiB of caches, %lu KiB of font files, %lu evicted, %lu over the cap\n",
+	    nfcache, FONT_CACHE_SIZE, ccsize / 1024, fsize / 1024, nfevict, nfoverrun);
+	err("color glyphs: %lu rasterized\n", nraster);
+	err("frames: %lu rendered, %lu grew caches or arenas of the bar (%lu allocations, not counting cairo, harfbuzz and xcb)\n",
+	    nframe, nallocframe, nalloc);
+	err("render requests: %lu coalesced, max %d fps\n", ncoalesce, FRAME_RATE);
+	err("wakeups: %lu total, %lu in the last minute, %d ms slack\n",
+	    nwakeup, wakeups_per_min, TIMER_SLACK);
+	err("samples: %lu offloaded, %lu overrun, %lu abandoned\n",
+	    noffload, noverrun, ntimeout);
+	err("clock: %lu steps, %lu resumes\n", nclockset, nresume);
+	err("scroll: %lu steps applied in %lu changes\n", nscroll, nscrollapply);
+	collect_get_stats(&cstats);
+	err("collect: %s, %lu reads, %lu syscalls, %lu batches (%.1f syscalls per batch)\n",
+	    cstats.uring ? "io_uring" : "pread", cstats.nread, cstats.nsyscall, cstats.nbatch,
+	    cstats.nbatch ? (double)cstats.nbatchsyscall / cstats.nbatch : 0);
+	err("poll sources:\n");
+	list_for_each(&pollfds, pos) {
+		pollfd = list_entry(pos, poll_fd_t, head);
+		err("  %s: %lu events in %lu wakeups (%.1f per wakeup), %lu failures, %lu restarts%s\n",
+		    pollfd->name ? pollfd->name : "unknown", pollfd->nevent, pollfd->nwakeup,
+		    pollfd->nwakeup ? (double)pollfd->nevent / pollfd->nwakeup : 0,
+		    pollfd->ndown, pollfd->nup, pollfd->fd < 0 ? ", down" : "");
+	}
+	snapshot_get_stats(&sstats);
+	err("render thread: %lu requests merged, %lu made while a frame was in flight\n",
+	    nmerge, ninflight);
+	err("async requests: %lu started, %lu timed out, %lu in flight, %lu at peak\n",
+	    nasync, nasync_timeout, nasync_inflight, nasync_peak);
+	err("snapshots: %lu published, %lu reclaimed, %lu retired\n",
+	    sstats.npublish, sstats.nreclaim, sstats.nretired);
+	pthread_mutex_unlock(&renderer.frame);
 }
 
 /**
@@ -1679,6 +5475,7 @@ poll_loop(void (* handler)())
  * @signum: signal number.
  *
  * The function stop polling if signum equals SIGINT or SIGTERM.
+ * Statistics are printed on the next wakeup if signum equals SIGUSR1.
  */
 void
 signal_handler(int signum)
@@ -1688,6 +5485,9 @@ signal_handler(int signum)
 	case SIGTERM:
 		poll_stop();
 		break;
+	case SIGUSR1:
+		stats_requested = 1;
+		break;
 	}
 }
 
@@ -1698,9 +5498,8 @@ void
 cleanup(xcb_connection_t *xcb)
 {
 	int i;
-	if (wintitle)
-		free(wintitle);
-
+	/* continuations may use the systray */
+	async_destroy();
 	if (tray)
 		systray_destroy(tray);
 	for (i = 0; i < ncol; i++) {
@@ -1729,6 +5528,7 @@ run()
 	act.sa_flags = 0;
 	sigaction(SIGTERM, &act, NULL);
 	sigaction(SIGINT, &act, NULL);
+	sigaction(SIGUSR1, &act, NULL);
 
 	setlocale(LC_ALL, "");
 
@@ -1742,9 +5542,6 @@ run()
 		die("xcb_ewmh_init_atoms(): Failed to initialize atoms\n");
 	FT_Init_FreeType(&ftlib);
 
-	/* get active widnow title */
-	windowtitle_update(xcb, 0);
-
 	if (!bspwmbar_init(xcb, scr)) {
 		err("bspwmbar_init(): Failed to init bspwmbar\n");
 		goto CLEANUP;
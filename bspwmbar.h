@@ -27,6 +27,8 @@ typedef struct {
 } graph_item_t;
 
 typedef union _module_t module_t;
+typedef struct _text_run_t text_run_t;
+typedef struct _module_sched_t module_sched_t;
 typedef module_t module_option_t;
 
 /* Draw context */
@@ -39,23 +41,68 @@ typedef int (* poll_init_handler_t)();
 typedef int (* poll_deinit_handler_t)();
 typedef poll_result_t (* poll_update_handler_t)();
 typedef struct {
-	int fd;
-	poll_init_handler_t init; /* initialize and return fd */
+	int fd; /* -1 while the source is down */
+	poll_init_handler_t init; /* initialize and return fd or -1, restarts the source on failures */
 	poll_deinit_handler_t deinit; /* close fd and cleanup resources */
+	poll_deinit_handler_t release; /* free state kept while the source is down */
 	poll_update_handler_t handler; /* event handler for fd */
 
+	/* statistics */
+	const char *name;
+	unsigned long nwakeup; /* calls of handler */
+	unsigned long nevent; /* events drained by handler */
+	unsigned long nup; /* restarts */
+	unsigned long ndown; /* failures */
+
 	list_head head;
 } poll_fd_t;
 
 void poll_add(poll_fd_t *);
 void poll_del(poll_fd_t *);
 
+/* Sampler */
+typedef bool (* sampler_update_t)(module_option_t *, void *);
+typedef void (* sampler_reset_t)(module_option_t *, void *);
+typedef struct {
+	sampler_update_t update; /* sample state and return true if changed */
+	sampler_reset_t reset; /* drop baselines of rates after resume, or NULL */
+	size_t size; /* size of state */
+	unsigned int interval; /* default interval in milliseconds */
+	bool align; /* align deadlines to multiples of interval on wall clock */
+	bool offload; /* sample on the worker pool, update must only touch state */
+} module_sampler_t;
+
+void *module_state(module_option_t *, const module_sampler_t *);
+void module_refresh(module_option_t *);
+void module_predict(module_option_t *, const void *);
+
+/* Scroll wheel */
+typedef void (* scroll_apply_t)(module_option_t *, int); /* apply net steps */
+int module_scroll(module_option_t *, int, scroll_apply_t);
+
+/* Asynchronous request */
+#define ASYNC_TIMEOUT 1000 /* default deadline of requests in milliseconds */
+typedef struct _async_t async_t;
+/* called with data, reply or NULL, and true if the deadline has passed */
+typedef bool (* async_func_t)(void *, void *, bool);
+
+async_t *async_xcb(unsigned int, unsigned int, async_func_t, void *);
+async_t *async_fd(int, unsigned int, async_func_t, void *);
+void async_cancel(async_t *);
+
+void render_lock();
+void render_unlock();
+
 /* Module */
 #define MODULE_BASE \
 	module_handler_t func; \
 	event_handler_t handler; \
 	char *prefix; \
-	char *suffix
+	char *suffix; \
+	unsigned int interval; /* update interval in milliseconds */ \
+	text_run_t *prefix_run; \
+	text_run_t *suffix_run; \
+	module_sched_t *sched
 
 typedef struct {
 	MODULE_BASE;
@@ -77,6 +124,9 @@ typedef struct {
 	char *unfocused;
 	char *fg;
 	char *fg_free;
+
+	text_run_t *focused_run;
+	text_run_t *unfocused_run;
 } module_desktop_t;
 
 typedef struct {
@@ -84,6 +134,8 @@ typedef struct {
 
 	char *label;
 	char *fg;
+
+	text_run_t *label_run;
 } module_text_t;
 
 typedef struct {
@@ -95,8 +147,11 @@ typedef struct {
 typedef struct {
 	MODULE_BASE;
 
-	unsigned int maxlen;
+	unsigned int maxlen; /* max number of characters */
+	int maxwidth; /* max width in pixels */
 	char *ellipsis;
+
+	text_run_t *ellipsis_run;
 } module_title_t;
 
 typedef struct {
@@ -165,6 +220,27 @@ union _module_t {
 	module_xbacklight_t xbacklight;
 };
 
+/* Monitor */
+typedef enum {
+	MONITOR_ANY = 0,
+	MONITOR_PRIMARY,
+	MONITOR_SECONDARY,
+} monitor_role_t;
+
+typedef struct {
+	const char *output; /* RandR output name, NULL matches any output */
+	monitor_role_t role;
+
+	module_t *left;
+	size_t nleft;
+	module_t *right;
+	size_t nright;
+} monitor_modules_t;
+
+#define MODULES(L, R) \
+	.left = (L), .nleft = LENGTH(L), \
+	.right = (R), .nright = LENGTH(R)
+
 xcb_connection_t *xcb_connection();
 
 color_t *color_load(const char *);
@@ -172,9 +248,13 @@ color_t *color_default_fg();
 color_t *color_default_bg();
 
 const char *draw_context_monitor_name(draw_context_t *);
+void *draw_context_alloc(draw_context_t *, size_t);
 
 void draw_text(draw_context_t *, const char *);
 void draw_color_text(draw_context_t *, color_t *, const char *);
+void draw_numeric(draw_context_t *, const char *);
+void draw_text_run(draw_context_t *, text_run_t **, const char *);
+void draw_color_text_run(draw_context_t *, color_t *, text_run_t **, const char *);
 void draw_bargraph(draw_context_t *, const char *, graph_item_t *, int);
 void draw_padding_em(draw_context_t *, double);
 
@@ -0,0 +1,328 @@
+/* See LICENSE file for copyright and license details. */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#if defined(HAVE_LIBURING)
+# include <liburing.h>
+#endif
+
+#include "collect.h"
+#include "util.h"
+
+/* max number of kept open files */
+#define COLLECT_MAX_FILES 64
+/* size of data read from a file at once */
+#define COLLECT_BUFSZ 16384
+
+/*
+ * Files of /proc and /sys read by samplers.
+ *
+ * Files are kept open and read from the start with pread(2), as their
+ * contents are generated on each read. collect_prefetch() reads all files
+ * of the given owners at once, with one io_uring submission when liburing
+ * is available, and the next collect_read() of each file returns the
+ * prefetched data.
+ */
+struct _collect_file_t {
+	const void *owner;
+	char *path;
+	int fd;
+	int index; /* index in files, also used in the registered files */
+	bool registered; /* registered to the ring */
+
+	char *data;
+	ssize_t len;
+	bool fresh; /* data has been prefetched and not read yet */
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static collect_file_t *files[COLLECT_MAX_FILES];
+static int nfile = 0;
+
+static atomic_ulong nbatch;
+static atomic_ulong nbatchsyscall;
+static atomic_ulong nsyscall;
+static atomic_ulong nread;
+
+#if defined(HAVE_LIBURING)
+/* held while the ring is used, prefetches fall back to pread if busy */
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct io_uring ring;
+static bool ring_ready = false;
+static bool ring_failed = false;
+static bool ring_files = false;
+
+/* functions */
+static bool ring_init();
+static int ring_prefetch(collect_file_t **, int);
+#endif
+static int file_prefetch(collect_file_t *);
+
+#if defined(HAVE_LIBURING)
+/**
+ * ring_init() - set up the ring and the sparse table of registered files.
+ *
+ * Must be called with ring_lock.
+ *
+ * Return: bool
+ */
+bool
+ring_init()
+{
+	int fds[COLLECT_MAX_FILES];
+	int i;
+
+	if (ring_ready || ring_failed)
+		return ring_ready;
+
+	if (io_uring_queue_init(COLLECT_MAX_FILES, &ring, 0) < 0) {
+		ring_failed = true;
+		return false;
+	}
+	for (i = 0; i < COLLECT_MAX_FILES; i++)
+		fds[i] = -1;
+	/* plain fds are used if the kernel has no sparse file table */
+	ring_files = !io_uring_register_files(&ring, fds, COLLECT_MAX_FILES);
+	ring_ready = true;
+	return true;
+}
+
+/**
+ * ring_prefetch() - read files with one submission.
+ * @fs: files to read.
+ * @n: number of files.
+ *
+ * Return: number of syscalls or 0 if the ring is not available.
+ */
+int
+ring_prefetch(collect_file_t **fs, int n)
+{
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	collect_file_t *f;
+	int i, nsys = 1;
+
+	if (pthread_mutex_trylock(&ring_lock))
+		return 0;
+	if (!ring_init()) {
+		pthread_mutex_unlock(&ring_lock);
+		return 0;
+	}
+
+	for (i = 0; i < n; i++) {
+		f = fs[i];
+		if (ring_files && !f->registered) {
+			f->registered = io_uring_register_files_update(&ring, f->index, &f->fd, 1) == 1;
+			nsys++;
+		}
+		sqe = io_uring_get_sqe(&ring);
+		if (f->registered) {
+			io_uring_prep_read(sqe, f->index, f->data, COLLECT_BUFSZ - 1, 0);
+			sqe->flags |= IOSQE_FIXED_FILE;
+		} else {
+			io_uring_prep_read(sqe, f->fd, f->data, COLLECT_BUFSZ - 1, 0);
+		}
+		io_uring_sqe_set_data(sqe, f);
+	}
+	if (io_uring_submit_and_wait(&ring, n) < 0) {
+		/* never wait for completions of a broken ring again */
+		io_uring_queue_exit(&ring);
+		ring_ready = false;
+		ring_failed = true;
+		pthread_mutex_unlock(&ring_lock);
+		return 0;
+	}
+
+	for (i = 0; i < n; i++) {
+		if (io_uring_wait_cqe(&ring, &cqe) < 0)
+			break;
+		f = io_uring_cqe_get_data(cqe);
+		f->len = cqe->res;
+		if (f->len >= 0) {
+			f->data[f->len] = '\0';
+			f->fresh = true;
+		}
+		io_uring_cqe_seen(&ring, cqe);
+	}
+	pthread_mutex_unlock(&ring_lock);
+	atomic_fetch_add(&nsyscall, nsys);
+	return nsys;
+}
+#endif
+
+/**
+ * file_prefetch() - read the file with pread(2).
+ * @f: collect_file_t
+ *
+ * Return: number of syscalls.
+ */
+int
+file_prefetch(collect_file_t *f)
+{
+	f->len = pread(f->fd, f->data, COLLECT_BUFSZ - 1, 0);
+	atomic_fetch_add(&nsyscall, 1);
+	if (f->len >= 0) {
+		f->data[f->len] = '\0';
+		f->fresh = true;
+	}
+	return 1;
+}
+
+/**
+ * collect_open() - open the file kept for reads of the owner.
+ * @owner: owner of the file, usually module options.
+ * @path: file path.
+ *
+ * Return: collect_file_t * or NULL on failure.
+ */
+collect_file_t *
+collect_open(const void *owner, const char *path)
+{
+	collect_file_t *f = NULL;
+	int i, fd;
+
+	pthread_mutex_lock(&lock);
+	for (i = 0; i < nfile; i++) {
+		if (files[i]->owner == owner && !strcmp(files[i]->path, path)) {
+			f = files[i];
+			break;
+		}
+	}
+	if (!f && nfile < COLLECT_MAX_FILES && (fd = open(path, O_RDONLY | O_CLOEXEC)) >= 0) {
+		atomic_fetch_add(&nsyscall, 1);
+		f = calloc(1, sizeof(collect_file_t));
+		f->owner = owner;
+		f->path = strdup(path);
+		f->fd = fd;
+		f->index = nfile;
+		f->data = malloc(COLLECT_BUFSZ);
+		files[nfile++] = f;
+	}
+	pthread_mutex_unlock(&lock);
+	return f;
+}
+
+/**
+ * collect_read() - read whole contents of the file.
+ * @f: collect_file_t
+ * @buf: buffer, the contents are nul terminated.
+ * @size: size of buf.
+ *
+ * Return: length of the contents or -1 on failure.
+ */
+ssize_t
+collect_read(collect_file_t *f, char *buf, size_t size)
+{
+	ssize_t len;
+
+	if (!f || !size)
+		return -1;
+	if (!f->fresh)
+		file_prefetch(f);
+	f->fresh = false;
+	atomic_fetch_add(&nread, 1);
+
+	if ((len = f->len) < 0)
+		return -1;
+	len = SMALLER((size_t)len, size - 1);
+	memcpy(buf, f->data, len);
+	buf[len] = '\0';
+	return len;
+}
+
+/**
+ * collect_owns() - check the owner has kept files.
+ * @owner: owner of files.
+ *
+ * Return: bool
+ */
+bool
+collect_owns(const void *owner)
+{
+	bool owns = false;
+	int i;
+
+	pthread_mutex_lock(&lock);
+	for (i = 0; i < nfile && !owns; i++)
+		owns = files[i]->owner == owner;
+	pthread_mutex_unlock(&lock);
+	return owns;
+}
+
+/**
+ * collect_prefetch() - read all files of the owners in one batch.
+ * @owners: owners of files.
+ * @nowner: number of owners.
+ *
+ * Files of an owner must not be read by other threads until the owner
+ * reads them.
+ */
+void
+collect_prefetch(const void **owners, int nowner)
+{
+	collect_file_t *fs[COLLECT_MAX_FILES];
+	int i, j, n = 0, nsys = 0;
+
+	pthread_mutex_lock(&lock);
+	for (i = 0; i < nfile; i++)
+		for (j = 0; j < nowner; j++)
+			if (files[i]->owner == owners[j])
+				fs[n++] = files[i];
+	pthread_mutex_unlock(&lock);
+	if (!n)
+		return;
+
+	atomic_fetch_add(&nbatch, 1);
+#if defined(HAVE_LIBURING)
+	nsys = ring_prefetch(fs, n);
+#endif
+	if (!nsys)
+		for (i = 0; i < n; i++)
+			nsys += file_prefetch(fs[i]);
+	atomic_fetch_add(&nbatchsyscall, nsys);
+}
+
+/**
+ * collect_get_stats() - get statistics of reads.
+ * @stats: (out) collect_stats_t
+ */
+void
+collect_get_stats(collect_stats_t *stats)
+{
+#if defined(HAVE_LIBURING)
+	stats->uring = ring_ready;
+#else
+	stats->uring = false;
+#endif
+	stats->nbatch = atomic_load(&nbatch);
+	stats->nbatchsyscall = atomic_load(&nbatchsyscall);
+	stats->nsyscall = atomic_load(&nsyscall);
+	stats->nread = atomic_load(&nread);
+}
+
+/**
+ * collect_destroy() - close all files.
+ */
+void
+collect_destroy()
+{
+	int i;
+
+#if defined(HAVE_LIBURING)
+	if (ring_ready)
+		io_uring_queue_exit(&ring);
+	ring_ready = false;
+#endif
+	for (i = 0; i < nfile; i++) {
+		close(files[i]->fd);
+		free(files[i]->path);
+		free(files[i]->data);
+		free(files[i]);
+	}
+	nfile = 0;
+}
@@ -0,0 +1,26 @@
+/* See LICENSE file for copyright and license details. */
+
+#ifndef BSPWMBAR_COLLECT_H_
+#define BSPWMBAR_COLLECT_H_
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+typedef struct _collect_file_t collect_file_t;
+
+typedef struct {
+	bool uring; /* reads are batched with io_uring */
+	unsigned long nbatch;
+	unsigned long nbatchsyscall; /* syscalls of batched reads */
+	unsigned long nsyscall;
+	unsigned long nread;
+} collect_stats_t;
+
+collect_file_t *collect_open(const void *, const char *);
+ssize_t collect_read(collect_file_t *, char *, size_t);
+bool collect_owns(const void *);
+void collect_prefetch(const void **, int);
+void collect_get_stats(collect_stats_t *);
+void collect_destroy();
+
+#endif /* BSPWMBAR_COLLECT_H_ */
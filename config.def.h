@@ -14,8 +14,23 @@
 #define NAME_MAXSZ  32
 /* max length of active window title */
 #define TITLE_MAXSZ 50
+/* max width of active window title in pixels, 0 means unlimited */
+#define TITLE_MAXWIDTH 0
 /* set window height */
 #define BAR_HEIGHT  24
+/* max frames per second, 0 means unlimited */
+#define FRAME_RATE  60
+/* granularity in milliseconds of module update deadlines to share wakeups */
+#define TIMER_SLACK 1000
+/* number of threads sampling modules which may block */
+#define SAMPLER_THREADS 2
+/* milliseconds after which a running sample is abandoned and its worker replaced */
+#define SAMPLER_TIMEOUT 5000
+/* range in milliseconds of delays to restart failed sources like bspwm */
+#define RESTART_BACKOFF_MIN 250
+#define RESTART_BACKOFF_MAX 30000
+/* milliseconds to accumulate scroll wheel steps before applying them */
+#define SCROLL_DELAY 100
 
 /* set font pattern for find fonts, see fonts-conf(5) */
 const char *fontname = "sans-serif:size=10";
@@ -31,6 +46,8 @@ const char *fontname = "sans-serif:size=10";
 #define ALTFGCOLOR "#7f7f7f"
 /* graph bg color */
 #define ALTBGCOLOR "#555555"
+/* fg color of modules showing the state before an abandoned sample */
+#define STALEFGCOLOR ALTFGCOLOR
 
 /*
  * Module definition
@@ -57,6 +74,7 @@ module_t left_modules[] = {
 		.title = {
 			.func = windowtitle,
 			.maxlen   = TITLE_MAXSZ,
+			.maxwidth = TITLE_MAXWIDTH,
 			.ellipsis = "…",
 		},
 	},
@@ -145,4 +163,25 @@ module_t right_modules[] = {
 	},
 };
 
+/*
+ * Module lists per monitor
+ *
+ * Entries are tried in order and the first one matching the output name and
+ * the role of a monitor is used. The default entry has neither and matches
+ * every monitor, so it must be the last one or it hides the entries after it.
+ */
+monitor_modules_t monitor_modules[] = {
+	// { /* only desktops and clock on secondary monitors */
+	// 	.role = MONITOR_SECONDARY,
+	// 	MODULES(secondary_left_modules, secondary_right_modules),
+	// },
+	// { /* modules for the specified output */
+	// 	.output = "HDMI-1",
+	// 	MODULES(hdmi_left_modules, hdmi_right_modules),
+	// },
+	{ /* default */
+		MODULES(left_modules, right_modules),
+	},
+};
+
 #endif
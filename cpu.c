@@ -1,12 +1,11 @@
 /* See LICENSE file for copyright and license details. */
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
 #if defined(__linux)
-# include <alloca.h>
 # include <sys/sysinfo.h>
 #elif defined(__OpenBSD__) || defined(__FreeBSD__)
 # include <sys/types.h>
@@ -18,6 +17,7 @@
 #endif
 
 #include "bspwmbar.h"
+#include "collect.h"
 #include "util.h"
 
 #if defined(__linux)
@@ -39,9 +39,33 @@ typedef struct {
 } CoreInfo;
 #endif
 
+/* max number of cores shown in the graph */
+#define MAX_CORES 256
+
+/*
+ * The state is copied between the sampler and the module, counters behind
+ * a and b are only touched by the sampler.
+ */
+typedef struct {
+	int nproc;
+	bool stale; /* counters in a were read before suspend */
+	CoreInfo *a;
+	CoreInfo *b;
+	double loadavgs[MAX_CORES];
+} cpu_state_t;
+
 /* functions */
 static int num_procs();
-static int cpu_perc(double **);
+static bool cpu_perc(module_option_t *, void *);
+static void cpu_reset(module_option_t *, void *);
+
+static const module_sampler_t sampler = {
+	.update = cpu_perc,
+	.reset = cpu_reset,
+	.size = sizeof(cpu_state_t),
+	.interval = 1000,
+	.offload = true,
+};
 
 static const char *deffgcols[4] = {
 	"#449f3d", /* success color */
@@ -49,7 +73,6 @@ static const char *deffgcols[4] = {
 	"#f5a70a", /* warning color */
 	"#ed5456", /* critical color */
 };
-static double *loadavgs = NULL;
 
 int
 num_procs()
@@ -75,45 +98,54 @@ num_procs()
 #endif
 }
 
-int
-cpu_perc(double **cores)
+/**
+ * cpu_perc() - sample usage of each core.
+ * @opts: module options.
+ * @state: cpu_state_t
+ *
+ * Return: true if any usage has been changed.
+ */
+bool
+cpu_perc(module_option_t *opts, void *state)
 {
-	static CoreInfo *a = NULL;
-	static CoreInfo *b = NULL;
-	static time_t prevtime;
+	cpu_state_t *cpu = state;
+	CoreInfo *a, *b;
+	double *loadavgs, prev[MAX_CORES];
 	int i = 0;
 	int nproc;
+	(void)opts;
 
 	if ((nproc = num_procs()) == -1)
-		return 0;
+		return false;
 
-	time_t curtime = time(NULL);
-	if (curtime - prevtime < 1) {
-		*cores = loadavgs;
-		return nproc;
+	nproc = SMALLER(nproc, MAX_CORES);
+	if (!cpu->nproc) {
+		cpu->a = (CoreInfo *)calloc(sizeof(CoreInfo), nproc);
+		cpu->b = (CoreInfo *)calloc(sizeof(CoreInfo), nproc);
+		cpu->nproc = nproc;
 	}
-	prevtime = curtime;
-
-	if (a == NULL)
-		a = (CoreInfo *)calloc(sizeof(CoreInfo), nproc);
-	if (b == NULL)
-		b = (CoreInfo *)calloc(sizeof(CoreInfo), nproc);
-	if (loadavgs == NULL)
-		loadavgs = (double *)calloc(sizeof(double), nproc);
+	a = cpu->a;
+	b = cpu->b;
+	loadavgs = cpu->loadavgs;
 
 	memcpy(b, a, sizeof(CoreInfo) * nproc);
+	memcpy(prev, loadavgs, sizeof(double) * nproc);
 
 #if defined(__linux)
-	FILE *fp;
-	if (!(fp = fopen("/proc/stat", "r")))
-		return 0;
+	char data[16384], *line, *next;
+	if (collect_read(collect_open(opts, "/proc/stat"), data, sizeof(data)) < 0)
+		return false;
 
-	while (fgets(buf, sizeof(buf), fp)) {
-		if (strncmp(buf, "cpu ", 4) == 0)
+	for (line = data; i < nproc && *line; line = next) {
+		if ((next = strchr(line, '\n')))
+			*next++ = '\0';
+		else
+			next = line + strlen(line);
+		if (strncmp(line, "cpu ", 4) == 0)
 			continue;
-		if (strncmp(buf, "cpu", 3) != 0)
+		if (strncmp(line, "cpu", 3) != 0)
 			break;
-		sscanf(buf, "%*s %lf %lf %lf %lf %lf %lf %lf", &a[i].user, &a[i].nice,
+		sscanf(line, "%*s %lf %lf %lf %lf %lf %lf %lf", &a[i].user, &a[i].nice,
 		       &a[i].system, &a[i].idle, &a[i].iowait, &a[i].irq,
 		       &a[i].softirq);
 		b[i].sum = (b[i].user + b[i].nice + b[i].system + b[i].idle +
@@ -126,7 +158,6 @@ cpu_perc(double **cores)
 		loadavgs[i] = used / (b[i].sum - a[i].sum);
 		i++;
 	}
-	fclose(fp);
 #elif defined(__OpenBSD__)
 	int mibcpu[3] = { CTL_KERN, 0, 0 };
 	size_t miblen = 3;
@@ -159,8 +190,29 @@ cpu_perc(double **cores)
 	loadavgs[i] = (double)(a[0].used - b[0].used) / (a[0].sum - b[0].sum);
 #endif
 
-	*cores = loadavgs;
-	return nproc;
+	if (cpu->stale) {
+		/* counters read after resume are the new baseline */
+		memcpy(loadavgs, prev, sizeof(double) * nproc);
+		cpu->stale = false;
+		return false;
+	}
+	return memcmp(prev, loadavgs, sizeof(double) * nproc) != 0;
+}
+
+/**
+ * cpu_reset() - drop counters read before suspend.
+ * @opts: module options.
+ * @state: cpu_state_t
+ *
+ * The next sample only reads the baseline and keeps the usage shown last.
+ */
+void
+cpu_reset(module_option_t *opts, void *state)
+{
+	cpu_state_t *cpu = state;
+	(void)opts;
+
+	cpu->stale = true;
 }
 
 void
@@ -168,8 +220,9 @@ cpugraph(draw_context_t *dc, module_option_t *opts)
 {
 	color_t *fgcols[4];
 	color_t *bgcol;
-	double *vals = NULL;
-	int i, ncore = cpu_perc(&vals);
+	cpu_state_t *cpu = module_state(opts, &sampler);
+	double *vals = cpu->loadavgs;
+	int i, ncore = cpu->nproc;
 
 	bgcol = color_load("#555555");
 	for (i = 0; i < 4; i++) {
@@ -179,7 +232,7 @@ cpugraph(draw_context_t *dc, module_option_t *opts)
 			fgcols[i] = color_load(deffgcols[i]);
 	}
 
-	graph_item_t *items = (graph_item_t *)alloca(sizeof(graph_item_t) * ncore);
+	graph_item_t *items = draw_context_alloc(dc, sizeof(graph_item_t) * ncore);
 	for (int i = 0; i < ncore; i++) {
 		items[i].bg = bgcol;
 		items[i].val = vals[i];
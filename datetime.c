@@ -1,8 +1,6 @@
 /* See LICENSE file for copyright and license details. */
 
-#if defined(__linux)
-# include <alloca.h>
-#endif
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -12,24 +10,89 @@
 #include "bspwmbar.h"
 #include "util.h"
 
-void
-datetime(draw_context_t *dc, module_option_t *opts)
+typedef struct {
+	char text[128];
+} datetime_state_t;
+
+/* functions */
+static bool datetime_update(module_option_t *, void *);
+static bool has_seconds(const char *);
+
+/* formats without seconds only change on minute boundaries */
+static const module_sampler_t minute_sampler = {
+	.update = datetime_update,
+	.size = sizeof(datetime_state_t),
+	.interval = 60000,
+	.align = true,
+};
+static const module_sampler_t second_sampler = {
+	.update = datetime_update,
+	.size = sizeof(datetime_state_t),
+	.interval = 1000,
+	.align = true,
+};
+
+/**
+ * has_seconds() - check the format contains conversions of seconds.
+ * @format: strftime(3) format.
+ *
+ * Return: bool
+ */
+bool
+has_seconds(const char *format)
+{
+	const char *p;
+
+	for (p = format; (p = strchr(p, '%')); p++) {
+		p++;
+		/* skip E and O modifiers */
+		if (*p == 'E' || *p == 'O')
+			p++;
+		if (!*p)
+			break;
+		if (strchr("STsrXc+", *p))
+			return true;
+	}
+	return false;
+}
+
+/**
+ * datetime_update() - format current time.
+ * @opts: module options.
+ * @state: datetime_state_t
+ *
+ * Return: true if the text has been changed.
+ */
+bool
+datetime_update(module_option_t *opts, void *state)
 {
+	datetime_state_t *date = state;
+	char text[sizeof(date->text)];
 	time_t timer = time(NULL);
 	struct tm *tptr = localtime(&timer);
 
+	if (!strftime(text, sizeof(text), opts->date.format, tptr))
+		text[0] = '\0';
+	if (!strcmp(text, date->text))
+		return false;
+	strcpy(date->text, text);
+	return true;
+}
+
+void
+datetime(draw_context_t *dc, module_option_t *opts)
+{
+	datetime_state_t *date;
+
 	if (!opts->date.format)
 		die("datetime(): arg is required for datetime");
 	if (!opts->date.prefix)
 		opts->date.prefix = "";
 	if (!opts->date.suffix)
 		opts->date.suffix = "";
-	int size = SMALLER(strlen(opts->date.format) + strlen(opts->date.prefix) +
-	                   strlen(opts->date.prefix) + 1, 128);
-	char *format = alloca(size);
-	snprintf(format, size, "%s%s%s", opts->date.prefix, opts->date.format,
-	         opts->date.suffix);
-	strftime(buf, sizeof(buf), format, tptr);
-
-	draw_text(dc, buf);
+	date = module_state(opts, has_seconds(opts->date.format) ? &second_sampler : &minute_sampler);
+
+	draw_text_run(dc, &opts->date.prefix_run, opts->date.prefix);
+	draw_numeric(dc, date->text);
+	draw_text_run(dc, &opts->date.suffix_run, opts->date.suffix);
 }
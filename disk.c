@@ -1,16 +1,27 @@
 /* See LICENSE file for copyright and license details. */
 
 #include <math.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <sys/statvfs.h>
-#include <time.h>
 
 #include "bspwmbar.h"
 #include "util.h"
 
+typedef struct {
+	int perc;
+} disk_state_t;
+
 /* functions */
 static inline int calc_used(struct statvfs);
-static int disk_perc(const char *);
+static bool disk_perc(module_option_t *, void *);
+
+static const module_sampler_t sampler = {
+	.update = disk_perc,
+	.size = sizeof(disk_state_t),
+	.interval = 10000,
+	.offload = true,
+};
 
 int
 calc_used(struct statvfs mp)
@@ -18,30 +29,40 @@ calc_used(struct statvfs mp)
 	return (mp.f_blocks - mp.f_bavail) / (double)mp.f_blocks * 100 + 0.5;
 }
 
-static int
-disk_perc(const char *mpoint)
+/**
+ * disk_perc() - sample usage of the mountpoint.
+ * @opts: module options.
+ * @state: disk_state_t
+ *
+ * Return: true if the usage has been changed.
+ */
+static bool
+disk_perc(module_option_t *opts, void *state)
 {
-	static struct statvfs mp;
-	static time_t prevtime;
+	disk_state_t *disk = state;
+	struct statvfs mp;
+	int perc = -1;
 
-	time_t curtime = time(NULL);
-	if (curtime - prevtime < 1)
-		return calc_used(mp);
-	prevtime = curtime;
-
-	if (statvfs(mpoint, &mp))
-		return -1;
-	return calc_used(mp);
+	if (!statvfs(opts->fs.mountpoint, &mp))
+		perc = calc_used(mp);
+	if (perc == disk->perc)
+		return false;
+	disk->perc = perc;
+	return true;
 }
 
 void
 filesystem(draw_context_t *dc, module_option_t *opts)
 {
-	int perc = disk_perc(opts->fs.mountpoint);
+	disk_state_t *disk = module_state(opts, &sampler);
+	char perc[16];
+
 	if (!opts->fs.prefix)
 		opts->fs.prefix = "";
 	if (!opts->fs.suffix)
 		opts->fs.suffix = "";
-	sprintf(buf, "%s%d%s", opts->fs.prefix, perc, opts->fs.suffix);
-	draw_text(dc, buf);
+	draw_text_run(dc, &opts->fs.prefix_run, opts->fs.prefix);
+	sprintf(perc, "%d", disk->perc);
+	draw_numeric(dc, perc);
+	draw_text_run(dc, &opts->fs.suffix_run, opts->fs.suffix);
 }
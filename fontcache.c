@@ -0,0 +1,445 @@
+/* See LICENSE file for copyright and license details. */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <fontconfig/fontconfig.h>
+
+#include "fontcache.h"
+#include "util.h"
+
+#define FONTCACHE_MAGIC   "BBFCACHE"
+#define FONTCACHE_VERSION 1
+#define FONTCACHE_FILE    "bspwmbar/fonts.cache"
+
+/*
+ * Layout of the cache file:
+ *
+ *   fontcache_header_t
+ *   fontcache_range_t[nrange]   sorted by first
+ *   char[strsize]               nul terminated font file paths
+ */
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t key; /* hash of the font pattern */
+	int64_t stamp; /* latest mtime of fontconfig configs and caches */
+	uint32_t nrange;
+	uint32_t strsize;
+} fontcache_header_t;
+
+typedef struct {
+	uint32_t first;
+	uint32_t last;
+	uint32_t path; /* offset in the string table */
+	int32_t index; /* face index in the font file */
+} fontcache_range_t;
+
+typedef struct {
+	uint32_t first;
+	uint32_t last;
+	const char *path;
+	int index;
+} fontcache_entry_t;
+
+struct _fontcache_t {
+	char *file;
+	uint32_t key;
+	int64_t stamp;
+
+	/* mapped cache file */
+	void *map;
+	size_t mapsize;
+	const fontcache_range_t *ranges;
+	uint32_t nrange;
+	const char *strs;
+
+	/* ranges found after the file was mapped */
+	fontcache_entry_t *added;
+	size_t nadded, addedcap;
+};
+
+/* functions */
+static char *fontcache_file();
+static int64_t fontconfig_stamp();
+static bool fontcache_map(fontcache_t *);
+static bool fontcache_valid(const fontcache_t *, const fontcache_header_t *);
+static int entry_compare(const void *, const void *);
+static bool mkdir_parent(const char *);
+
+/**
+ * fontcache_file() - get path of the cache file.
+ *
+ * Return: allocated path or NULL if no cache directory is known.
+ */
+char *
+fontcache_file()
+{
+	const char *dir = getenv("XDG_CACHE_HOME");
+	const char *home = getenv("HOME");
+	char *file;
+	size_t len;
+
+	if (dir && *dir) {
+		len = strlen(dir) + strlen(FONTCACHE_FILE) + 2;
+		file = malloc(len);
+		snprintf(file, len, "%s/%s", dir, FONTCACHE_FILE);
+	} else if (home && *home) {
+		len = strlen(home) + strlen(FONTCACHE_FILE) + 9;
+		file = malloc(len);
+		snprintf(file, len, "%s/.cache/%s", home, FONTCACHE_FILE);
+	} else {
+		return NULL;
+	}
+	return file;
+}
+
+/**
+ * fontconfig_stamp() - get the latest mtime of fontconfig configs and caches.
+ *
+ * The cache file is invalidated when any of them has been changed.
+ *
+ * Return: int64_t
+ */
+int64_t
+fontconfig_stamp()
+{
+	FcStrList *lists[] = { FcConfigGetConfigFiles(NULL), FcConfigGetCacheDirs(NULL) };
+	FcChar8 *path;
+	struct stat st;
+	int64_t stamp = 0;
+	size_t i;
+
+	for (i = 0; i < LENGTH(lists); i++) {
+		if (!lists[i])
+			continue;
+		while ((path = FcStrListNext(lists[i])))
+			if (!stat((const char *)path, &st))
+				stamp = BIGGER(stamp, (int64_t)st.st_mtime);
+		FcStrListDone(lists[i]);
+	}
+	return stamp;
+}
+
+/**
+ * fontcache_valid() - check the mapped cache file.
+ * @fc: fontcache_t that has the map.
+ * @header: header of the map.
+ *
+ * Lookups trust the map, so every range must be in order and refer to a
+ * path in the string table.
+ *
+ * Return: bool
+ */
+bool
+fontcache_valid(const fontcache_t *fc, const fontcache_header_t *header)
+{
+	const fontcache_range_t *ranges = (const fontcache_range_t *)(header + 1);
+	uint64_t size;
+	uint32_t i;
+
+	size = sizeof(fontcache_header_t) + (uint64_t)header->nrange * sizeof(fontcache_range_t) + header->strsize;
+	if (memcmp(header->magic, FONTCACHE_MAGIC, sizeof(header->magic)) ||
+	    header->version != FONTCACHE_VERSION || header->key != fc->key ||
+	    header->stamp != fc->stamp || size != fc->mapsize ||
+	    (header->strsize && ((char *)fc->map)[size - 1] != '\0'))
+		return false;
+
+	for (i = 0; i < header->nrange; i++) {
+		if (ranges[i].path >= header->strsize || ranges[i].first > ranges[i].last)
+			return false;
+		if (i && ranges[i].first <= ranges[i - 1].last)
+			return false;
+	}
+	return true;
+}
+
+/**
+ * fontcache_map() - map the cache file if it is valid.
+ * @fc: fontcache_t
+ *
+ * Return: bool
+ */
+bool
+fontcache_map(fontcache_t *fc)
+{
+	const fontcache_header_t *header;
+	struct stat st;
+	int fd;
+
+	if ((fd = open(fc->file, O_RDONLY)) < 0)
+		return false;
+	if (fstat(fd, &st) || (size_t)st.st_size < sizeof(fontcache_header_t)) {
+		close(fd);
+		return false;
+	}
+	fc->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (fc->map == MAP_FAILED) {
+		fc->map = NULL;
+		return false;
+	}
+	fc->mapsize = st.st_size;
+
+	header = fc->map;
+	if (!fontcache_valid(fc, header)) {
+		munmap(fc->map, fc->mapsize);
+		fc->map = NULL;
+		fc->mapsize = 0;
+		return false;
+	}
+
+	fc->ranges = (const fontcache_range_t *)(header + 1);
+	fc->nrange = header->nrange;
+	fc->strs = (const char *)(fc->ranges + fc->nrange);
+	return true;
+}
+
+/**
+ * fontcache_new() - open the fallback font cache of the pattern.
+ * @pattern: font pattern string.
+ *
+ * Return: fontcache_t *
+ */
+fontcache_t *
+fontcache_new(const char *pattern)
+{
+	fontcache_t *fc = calloc(1, sizeof(fontcache_t));
+
+	fc->key = strhash(pattern);
+	fc->stamp = fontconfig_stamp();
+	if ((fc->file = fontcache_file()))
+		fontcache_map(fc);
+
+	return fc;
+}
+
+/**
+ * fontcache_lookup() - find the font file that contains the rune.
+ * @fc: fontcache_t
+ * @rune: codepoint.
+ * @path: (out) path of the font file.
+ * @index: (out) face index in the font file.
+ *
+ * Return: bool
+ */
+bool
+fontcache_lookup(fontcache_t *fc, uint32_t rune, const char **path, int *index)
+{
+	const fontcache_range_t *range;
+	size_t i, lo = 0, hi = fc->nrange;
+
+	/* binary search on mapped ranges */
+	while (lo < hi) {
+		i = (lo + hi) / 2;
+		range = &fc->ranges[i];
+		if (rune < range->first) {
+			hi = i;
+		} else if (rune > range->last) {
+			lo = i + 1;
+		} else {
+			*path = &fc->strs[range->path];
+			*index = range->index;
+			return true;
+		}
+	}
+
+	for (i = 0; i < fc->nadded; i++) {
+		if (BETWEEN(rune, fc->added[i].first, fc->added[i].last)) {
+			*path = fc->added[i].path;
+			*index = fc->added[i].index;
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * fontcache_add() - record the font file that contains the rune.
+ * @fc: fontcache_t
+ * @rune: codepoint.
+ * @path: path of the font file.
+ * @index: face index in the font file.
+ */
+void
+fontcache_add(fontcache_t *fc, uint32_t rune, const char *path, int index)
+{
+	fontcache_entry_t *entry;
+	size_t i;
+
+	/* extend a neighbor range of the same face */
+	for (i = 0; i < fc->nadded; i++) {
+		entry = &fc->added[i];
+		if (entry->index != index || strcmp(entry->path, path))
+			continue;
+		if (entry->last + 1 == rune) {
+			entry->last = rune;
+			return;
+		}
+		if (entry->first == rune + 1) {
+			entry->first = rune;
+			return;
+		}
+	}
+
+	if (fc->nadded >= fc->addedcap) {
+		fc->addedcap += 16;
+		fc->added = realloc(fc->added, fc->addedcap * sizeof(fontcache_entry_t));
+	}
+	entry = &fc->added[fc->nadded++];
+	entry->first = entry->last = rune;
+	entry->path = strdup(path);
+	entry->index = index;
+}
+
+int
+entry_compare(const void *a, const void *b)
+{
+	const fontcache_entry_t *ea = a, *eb = b;
+	return (ea->first > eb->first) - (ea->first < eb->first);
+}
+
+/**
+ * mkdir_parent() - create parent directories of the file.
+ * @file: file path.
+ *
+ * Return: bool
+ */
+bool
+mkdir_parent(const char *file)
+{
+	char *dir = strdup(file), *p;
+	bool ok = true;
+
+	for (p = strchr(dir + 1, '/'); p; p = strchr(p + 1, '/')) {
+		*p = '\0';
+		if (mkdir(dir, 0755) && access(dir, F_OK))
+			ok = false;
+		*p = '/';
+	}
+	free(dir);
+	return ok;
+}
+
+/**
+ * fontcache_save() - write the merged ranges to the cache file.
+ * @fc: fontcache_t
+ *
+ * Return: bool
+ */
+bool
+fontcache_save(fontcache_t *fc)
+{
+	fontcache_header_t header = { 0 };
+	fontcache_entry_t *entries;
+	fontcache_range_t *ranges;
+	uint32_t *offsets;
+	char *strs = NULL, *tmp;
+	size_t i, j, n = 0, len;
+	FILE *fp = NULL;
+	bool ok;
+
+	if (!fc->file || !fc->nadded)
+		return true;
+
+	/* merge mapped ranges and new ranges */
+	entries = calloc(fc->nrange + fc->nadded, sizeof(fontcache_entry_t));
+	for (i = 0; i < fc->nrange; i++) {
+		entries[n].first = fc->ranges[i].first;
+		entries[n].last = fc->ranges[i].last;
+		entries[n].path = &fc->strs[fc->ranges[i].path];
+		entries[n++].index = fc->ranges[i].index;
+	}
+	for (i = 0; i < fc->nadded; i++)
+		entries[n++] = fc->added[i];
+	qsort(entries, n, sizeof(fontcache_entry_t), entry_compare);
+
+	/* coalesce adjacent ranges of the same face */
+	for (i = 0, j = 1; j < n; j++) {
+		if (entries[i].last + 1 == entries[j].first &&
+		    entries[i].index == entries[j].index &&
+		    !strcmp(entries[i].path, entries[j].path))
+			entries[i].last = entries[j].last;
+		else
+			entries[++i] = entries[j];
+	}
+	n = n ? i + 1 : 0;
+
+	/* build ranges and string table */
+	ranges = calloc(n, sizeof(fontcache_range_t));
+	offsets = calloc(n, sizeof(uint32_t));
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < i; j++)
+			if (!strcmp(entries[i].path, entries[j].path))
+				break;
+		if (j < i) {
+			offsets[i] = offsets[j];
+		} else {
+			len = strlen(entries[i].path) + 1;
+			strs = realloc(strs, header.strsize + len);
+			memcpy(&strs[header.strsize], entries[i].path, len);
+			offsets[i] = header.strsize;
+			header.strsize += len;
+		}
+		ranges[i].first = entries[i].first;
+		ranges[i].last = entries[i].last;
+		ranges[i].path = offsets[i];
+		ranges[i].index = entries[i].index;
+	}
+
+	memcpy(header.magic, FONTCACHE_MAGIC, sizeof(header.magic));
+	header.version = FONTCACHE_VERSION;
+	header.key = fc->key;
+	header.stamp = fc->stamp;
+	header.nrange = n;
+
+	/* replace the cache file atomically */
+	len = strlen(fc->file) + 5;
+	tmp = malloc(len);
+	snprintf(tmp, len, "%s.tmp", fc->file);
+	ok = mkdir_parent(fc->file) && (fp = fopen(tmp, "w"));
+	if (ok) {
+		ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+		     fwrite(ranges, sizeof(fontcache_range_t), n, fp) == n &&
+		     fwrite(strs, 1, header.strsize, fp) == header.strsize;
+		ok = !fclose(fp) && ok && !rename(tmp, fc->file);
+		if (!ok)
+			unlink(tmp);
+	}
+
+	free(tmp);
+	free(strs);
+	free(offsets);
+	free(ranges);
+	free(entries);
+	return ok;
+}
+
+/**
+ * fontcache_destroy() - save and free the cache.
+ * @fc: fontcache_t
+ */
+void
+fontcache_destroy(fontcache_t *fc)
+{
+	size_t i;
+
+	if (!fc)
+		return;
+	if (!fontcache_save(fc))
+		err("fontcache_save(): failed to write %s\n", fc->file);
+
+	if (fc->map)
+		munmap(fc->map, fc->mapsize);
+	for (i = 0; i < fc->nadded; i++)
+		free((char *)fc->added[i].path);
+	free(fc->added);
+	free(fc->file);
+	free(fc);
+}
@@ -0,0 +1,17 @@
+/* See LICENSE file for copyright and license details. */
+
+#ifndef BSPWMBAR_FONTCACHE_H_
+#define BSPWMBAR_FONTCACHE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct _fontcache_t fontcache_t;
+
+fontcache_t *fontcache_new(const char *);
+bool fontcache_lookup(fontcache_t *, uint32_t, const char **, int *);
+void fontcache_add(fontcache_t *, uint32_t, const char *, int);
+bool fontcache_save(fontcache_t *);
+void fontcache_destroy(fontcache_t *);
+
+#endif /* BSPWMBAR_FONTCACHE_H_ */
@@ -1,10 +1,10 @@
 /* See LICENSE file for copyright and license details. */
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
 #if defined(__FreeBSD__)
 # include <sys/types.h>
 # include <sys/resource.h>
@@ -15,6 +15,7 @@
 #endif
 
 #include "bspwmbar.h"
+#include "collect.h"
 #include "util.h"
 
 #if defined(__linux)
@@ -34,9 +35,20 @@ typedef struct {
 } MemInfo;
 #endif
 
+typedef struct {
+	double used;
+} mem_state_t;
+
 /* functions */
 static inline double calc_used(MemInfo);
-static double mem_perc();
+static bool mem_perc(module_option_t *, void *);
+
+static const module_sampler_t sampler = {
+	.update = mem_perc,
+	.size = sizeof(mem_state_t),
+	.interval = 1000,
+	.offload = true,
+};
 
 static const char *deffgcols[4] = {
 	"#449f3d", /* success color */
@@ -57,48 +69,59 @@ calc_used(MemInfo mem)
 #endif
 }
 
-double
-mem_perc()
+/**
+ * mem_perc() - sample memory usage.
+ * @opts: module options.
+ * @state: mem_state_t
+ *
+ * Return: true if the usage has been changed.
+ */
+bool
+mem_perc(module_option_t *opts, void *state)
 {
-	static time_t prevtime = { 0 };
-	static MemInfo a = { 0 };
-
-	time_t curtime = time(NULL);
-	if (curtime - prevtime < 1)
-		return calc_used(a);
-	prevtime = curtime;
+	mem_state_t *mem = state;
+	MemInfo a = { 0 };
+	double used;
+	(void)opts;
 
 #if defined(__linux)
-	FILE *fp;
-	if (!(fp = fopen("/proc/meminfo", "r")))
-		return 0;
+	char data[4096], *line;
+	if (collect_read(collect_open(opts, "/proc/meminfo"), data, sizeof(data)) < 0)
+		return false;
 
-	while (fgets(buf, sizeof(buf), fp)) {
-		if (strncmp(buf, "MemTotal:", 9) == 0)
-			sscanf(buf, "%*s %lu kB", &a.total);
-		else if (strncmp(buf, "MemAvailable:", 8) == 0)
-			sscanf(buf, "%*s %lu kB", &a.available);
+	for (line = data; line; line = strchr(line, '\n')) {
+		if (*line == '\n')
+			line++;
+		if (strncmp(line, "MemTotal:", 9) == 0)
+			sscanf(line, "%*s %lu kB", &a.total);
+		else if (strncmp(line, "MemAvailable:", 8) == 0)
+			sscanf(line, "%*s %lu kB", &a.available);
 	}
-	fclose(fp);
+	if (!a.total)
+		return false;
 #elif defined(__OpenBSD__)
 	int mib[] = { CTL_VM, VM_UVMEXP };
 	size_t len = sizeof(a);
 	if (sysctl(mib, 2, &a, &len, NULL, 0) < 0)
-		return 0;
+		return false;
 #elif defined(__FreeBSD__)
 	size_t len = sizeof(a.total); // all members are uint64_t, probably won't change
 	if (sysctlbyname("hw.physmem", &a.total, &len, NULL, 0) < 0)
-		return 0;
+		return false;
 	if (sysctlbyname("hw.pagesize", &a.pagesize, &len, NULL, 0) < 0)
-		return 0;
+		return false;
 	if (sysctlbyname("vm.stats.vm.v_free_count", &a.free, &len, NULL, 0) < 0)
-		return 0;
+		return false;
 	if (sysctlbyname("vm.stats.vm.v_inactive_count", &a.inactive, &len, NULL, 0) < 0)
-		return 0;
+		return false;
 	if (sysctlbyname("vm.stats.vm.v_cache_count", &a.cache, &len, NULL, 0) < 0)
-		return 0;
+		return false;
 #endif
-	return calc_used(a);
+	used = calc_used(a);
+	if (used == mem->used)
+		return false;
+	mem->used = used;
+	return true;
 }
 
 void
@@ -107,7 +130,8 @@ memgraph(draw_context_t *dc, module_option_t *opts)
 	graph_item_t items[10];
 	color_t *fgcols[4];
 	color_t *bgcol;
-	double used = mem_perc();
+	mem_state_t *mem = module_state(opts, &sampler);
+	double used = mem->used;
 	int i;
 
 	bgcol = color_load("#555555");
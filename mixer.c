@@ -1,5 +1,6 @@
 /* See LICENSE file for copyright and license details. */
 
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -12,24 +13,66 @@
 #include "util.h"
 #include "bspwmbar.h"
 
+#define MIXER_STEP 6
+
 typedef struct {
 	int8_t lvol;
 	int8_t rvol;
 } mixer_t;
 
+typedef struct {
+	bool loaded;
+	int8_t vol;
+} mixer_state_t;
+
 static bool mixer_load(const char *, mixer_t *);
+static bool mixer_update(module_option_t *, void *);
 static void mixer_set(int8_t);
+static void mixer_apply(module_option_t *, int);
+
+static const module_sampler_t sampler = {
+	.update = mixer_update,
+	.size = sizeof(mixer_state_t),
+	.interval = 1000,
+};
 
 void
 mixer(draw_context_t *dc, module_option_t *opts)
 {
-	mixer_t mixer;
+	mixer_state_t *state = module_state(opts, &sampler);
+	char vol[16];
 
-	if (!mixer_load(opts->mixer.device, &mixer))
+	if (!state->loaded)
 		return;
 
-	sprintf(buf, "%s%i%s", opts->mixer.prefix, BIGGER(mixer.lvol, mixer.rvol), opts->mixer.suffix);
-	draw_text(dc, buf);
+	draw_text_run(dc, &opts->mixer.prefix_run, opts->mixer.prefix);
+	sprintf(vol, "%i", state->vol);
+	draw_numeric(dc, vol);
+	draw_text_run(dc, &opts->mixer.suffix_run, opts->mixer.suffix);
+}
+
+/**
+ * mixer_update() - sample volume of the mixer.
+ * @opts: module options.
+ * @state: mixer_state_t
+ *
+ * Return: true if the volume has been changed.
+ */
+bool
+mixer_update(module_option_t *opts, void *state)
+{
+	mixer_state_t *mstate = state;
+	mixer_t mixer = { 0 };
+	bool loaded;
+	int8_t vol;
+
+	loaded = mixer_load(opts->mixer.device, &mixer);
+	vol = loaded ? BIGGER(mixer.lvol, mixer.rvol) : 0;
+	if (loaded == mstate->loaded && vol == mstate->vol)
+		return false;
+	mstate->loaded = loaded;
+	mstate->vol = vol;
+	return true;
 }
 
 static char *device = NULL;
@@ -75,36 +118,52 @@ mixer_set(int8_t vol)
 	}
 }
 
+/**
+ * mixer_apply() - set the volume moved by the scroll wheel.
+ * @opts: module options.
+ * @steps: net steps of the scroll wheel.
+ */
 void
-mixer_ev(xcb_generic_event_t *ev, module_option_t *opts)
+mixer_apply(module_option_t *opts, int steps)
 {
 	mixer_t mixer;
+	int cur;
+
+	if (mixer_load(opts->mixer.device, &mixer)) {
+		cur = BIGGER(mixer.lvol, mixer.rvol) + MIXER_STEP * steps;
+		mixer_set((int8_t)SMALLER(BIGGER(cur, 0), 100));
+	}
+	module_refresh(opts);
+}
+
+void
+mixer_ev(xcb_generic_event_t *ev, module_option_t *opts)
+{
+	mixer_state_t *state = module_state(opts, &sampler);
+	mixer_state_t predicted = *state;
 	xcb_button_press_event_t *button;
-	double cur;
-	const double step = 6;
+	int steps;
 
-	if (!mixer_load(opts->mixer.device, &mixer))
+	if (!state->loaded)
 		return;
 
-	cur = BIGGER(mixer.lvol, mixer.rvol);
-
 	switch (ev->response_type & ~0x80) {
 	case XCB_BUTTON_PRESS:
 		button = (xcb_button_press_event_t *)ev;
 		switch (button->detail) {
 		case XCB_BUTTON_INDEX_4:
-			cur = (cur / step) * step + step;
-			if (cur > 100)
-				cur = 100;
-			mixer_set((int8_t)cur);
+			steps = module_scroll(opts, 1, mixer_apply);
 			break;
 		case XCB_BUTTON_INDEX_5:
-			cur = (cur / step) * step - step;
-			if (cur < 0)
-				cur = 0;
-			mixer_set((int8_t)cur);
+			steps = module_scroll(opts, -1, mixer_apply);
 			break;
+		default:
+			module_refresh(opts);
+			return;
 		}
+		/* the mixer is written once the wheel stops */
+		predicted.vol = SMALLER(BIGGER(state->vol + MIXER_STEP * steps, 0), 100);
+		module_predict(opts, &predicted);
 		break;
 	}
 }
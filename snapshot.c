@@ -0,0 +1,140 @@
+/* See LICENSE file for copyright and license details. */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "snapshot.h"
+
+/*
+ * Read-copy-update of states shared with the render thread.
+ *
+ * The event thread publishes a new snapshot by swapping the pointer, and the
+ * replaced one is retired with the generation of the swap. The render thread
+ * records the generation it has seen when it enters a read section, so a
+ * retired snapshot is freed once the reader is outside of any section or has
+ * entered one after the swap.
+ *
+ * There is one writer (the event thread) and one reader (the render thread).
+ */
+typedef struct {
+	void *data;
+	snapshot_free_t free;
+	uint64_t gen; /* generation of the swap */
+} retired_t;
+
+static atomic_uint_fast64_t gen = 1;
+/* generation seen by the reader, 0 outside of read sections */
+static atomic_uint_fast64_t reader = 0;
+
+static retired_t *retired;
+static int nretired = 0, retiredcap = 0;
+static unsigned long npublish = 0;
+static unsigned long nreclaim = 0;
+
+/**
+ * snapshot_publish() - replace the snapshot.
+ * @slot: snapshot_t
+ * @data: new snapshot or NULL, it must not be modified after this.
+ * @free: function to free the replaced snapshot.
+ *
+ * This must be called from the event thread.
+ */
+void
+snapshot_publish(snapshot_t *slot, void *data, snapshot_free_t free)
+{
+	void *old = atomic_exchange(slot, data);
+
+	npublish++;
+	if (!old)
+		return;
+	if (nretired >= retiredcap) {
+		retiredcap += 16;
+		retired = realloc(retired, retiredcap * sizeof(retired_t));
+	}
+	retired[nretired].data = old;
+	retired[nretired].free = free;
+	retired[nretired++].gen = atomic_fetch_add(&gen, 1) + 1;
+}
+
+/**
+ * snapshot_get() - get the current snapshot.
+ * @slot: snapshot_t
+ *
+ * The render thread must hold the snapshot in a read section.
+ *
+ * Return: snapshot or NULL.
+ */
+void *
+snapshot_get(snapshot_t *slot)
+{
+	return atomic_load(slot);
+}
+
+/**
+ * snapshot_read_lock() - enter a read section on the render thread.
+ *
+ * Snapshots got in the section are not freed until snapshot_read_unlock().
+ */
+void
+snapshot_read_lock()
+{
+	atomic_store(&reader, atomic_load(&gen));
+}
+
+/**
+ * snapshot_read_unlock() - leave the read section.
+ */
+void
+snapshot_read_unlock()
+{
+	atomic_store(&reader, 0);
+}
+
+/**
+ * snapshot_reclaim() - free retired snapshots the reader cannot see.
+ *
+ * This must be called from the event thread.
+ */
+void
+snapshot_reclaim()
+{
+	uint64_t seen = atomic_load(&reader);
+	int i, n = 0;
+
+	for (i = 0; i < nretired; i++) {
+		if (!seen || seen >= retired[i].gen) {
+			retired[i].free(retired[i].data);
+			nreclaim++;
+		} else {
+			retired[n++] = retired[i];
+		}
+	}
+	nretired = n;
+}
+
+/**
+ * snapshot_get_stats() - get statistics of snapshots.
+ * @stats: (out) snapshot_stats_t
+ */
+void
+snapshot_get_stats(snapshot_stats_t *stats)
+{
+	stats->npublish = npublish;
+	stats->nreclaim = nreclaim;
+	stats->nretired = nretired;
+}
+
+/**
+ * snapshot_destroy() - free all retired snapshots.
+ *
+ * This must be called after the render thread has stopped.
+ */
+void
+snapshot_destroy()
+{
+	snapshot_read_unlock();
+	snapshot_reclaim();
+	free(retired);
+	retired = NULL;
+	retiredcap = 0;
+}
@@ -0,0 +1,26 @@
+/* See LICENSE file for copyright and license details. */
+
+#ifndef BSPWMBAR_SNAPSHOT_H_
+#define BSPWMBAR_SNAPSHOT_H_
+
+#include <stdatomic.h>
+
+/* published immutable data, written by the event thread only */
+typedef _Atomic(void *) snapshot_t;
+typedef void (* snapshot_free_t)(void *);
+
+typedef struct {
+	unsigned long npublish;
+	unsigned long nreclaim;
+	unsigned long nretired; /* retired and not yet reclaimed */
+} snapshot_stats_t;
+
+void snapshot_publish(snapshot_t *, void *, snapshot_free_t);
+void *snapshot_get(snapshot_t *);
+void snapshot_read_lock();
+void snapshot_read_unlock();
+void snapshot_reclaim();
+void snapshot_get_stats(snapshot_stats_t *);
+void snapshot_destroy();
+
+#endif /* BSPWMBAR_SNAPSHOT_H_ */
@@ -52,18 +52,33 @@ struct _systray_t {
 	xcb_window_t win;
 	int icon_size;
 	list_head items;
+
+	/* atoms used by event handling */
+	xcb_atom_t xembed;
+	xcb_atom_t xembed_info;
+	xcb_atom_t opcode;
 };
 
+/* request for a tray icon waiting the reply of _XEMBED_INFO */
+typedef struct {
+	systray_t *tray;
+	xcb_window_t win;
+	xcb_void_cookie_t reparent;
+} systray_request_t;
+
 /* functions */
-static bool xembed_send(xcb_connection_t *, xcb_window_t, long, long, long, long);
-static bool xembed_embedded_notify(systray_t *, xcb_window_t, long);
+static void xembed_send(systray_t *, xcb_window_t, long, long, long, long);
+static void xembed_embedded_notify(systray_t *, xcb_window_t, long);
 static int xembed_unembed_window(systray_t *, xcb_window_t);
-static bool xembed_getinfo(systray_t *, xcb_window_t, xembed_info_t *);
+static xcb_get_property_cookie_t xembed_getinfo(systray_t *, xcb_window_t);
+static bool xembed_getinfo_reply(xcb_get_property_reply_t *, xembed_info_t *);
 static xcb_atom_t get_systray_atom(xcb_connection_t *);
 static bool systray_set_selection_owner(systray_t *, xcb_atom_t);
 static bool systray_get_ownership(systray_t *);
 static systray_item_t *systray_append_item(systray_t *, xcb_window_t);
 static systray_item_t *systray_find_item(systray_t *, xcb_window_t);
+static bool systray_dock(void *, void *, bool);
+static bool systray_update_info(void *, void *, bool);
 
 xcb_atom_t
 get_systray_atom(xcb_connection_t *xcb)
@@ -123,6 +138,9 @@ systray_new(xcb_connection_t *xcb, xcb_screen_t *scr, xcb_window_t win)
 		free(tray);
 		return NULL;
 	}
+	tray->xembed = xcb_atom_get(tray->xcb, "_XEMBED", false);
+	tray->xembed_info = xcb_atom_get(tray->xcb, "_XEMBED_INFO", false);
+	tray->opcode = xcb_atom_get(tray->xcb, "_NET_SYSTEM_TRAY_OPCODE", false);
 
 	ev.response_type = XCB_CLIENT_MESSAGE;
 	ev.type = xcb_atom_get(tray->xcb, "MANAGER", false);
@@ -137,14 +155,20 @@ systray_new(xcb_connection_t *xcb, xcb_screen_t *scr, xcb_window_t win)
 	return tray;
 }
 
-bool
-xembed_send(xcb_connection_t *xcb, xcb_window_t win, long message, long d1, long d2, long d3)
+/**
+ * xembed_send() - send the XEMBED message to the window.
+ *
+ * The message is not checked, an error of a destroyed window is handled as
+ * an event.
+ */
+void
+xembed_send(systray_t *tray, xcb_window_t win, long message, long d1, long d2, long d3)
 {
 	xcb_client_message_event_t ev = { 0 };
 
 	ev.response_type = XCB_CLIENT_MESSAGE;
 	ev.window = win;
-	ev.type = xcb_atom_get(xcb, "_XEMBED", false);
+	ev.type = tray->xembed;
 	ev.format = 32;
 	ev.data.data32[0] = XCB_TIME_CURRENT_TIME;
 	ev.data.data32[1] = message;
@@ -152,17 +176,13 @@ xembed_send(xcb_connection_t *xcb, xcb_window_t win, long message, long d1, long
 	ev.data.data32[3] = d2;
 	ev.data.data32[4] = d3;
 
-	if (xcb_request_check(xcb, xcb_send_event(xcb, 0, win, XCB_EVENT_MASK_STRUCTURE_NOTIFY, (const char *)&ev)))
-		return false;
-	xcb_flush(xcb);
-
-	return true;
+	xcb_send_event(tray->xcb, 0, win, XCB_EVENT_MASK_STRUCTURE_NOTIFY, (const char *)&ev);
 }
 
-bool
+void
 xembed_embedded_notify(systray_t *tray, xcb_window_t win, long version)
 {
-	return xembed_send(tray->xcb, win, XEMBED_EMBEDDED_NOTIFY, 0, tray->win, version);
+	xembed_send(tray, win, XEMBED_EMBEDDED_NOTIFY, 0, tray->win, version);
 }
 
 int
@@ -174,23 +194,38 @@ xembed_unembed_window(systray_t *tray, xcb_window_t child)
 	return 0;
 }
 
+/**
+ * xembed_getinfo() - request _XEMBED_INFO of the window.
+ * @tray: systray_t
+ * @win: embedded window.
+ *
+ * Return: cookie to be passed to async_xcb().
+ */
+xcb_get_property_cookie_t
+xembed_getinfo(systray_t *tray, xcb_window_t win)
+{
+	return xcb_get_property(tray->xcb, 0, win, tray->xembed_info, XCB_GET_PROPERTY_TYPE_ANY, 0, 8);
+}
+
+/**
+ * xembed_getinfo_reply() - parse the reply of xembed_getinfo().
+ * @prop: reply or NULL.
+ * @info: (out) xembed_info_t
+ *
+ * Return: false if the window has no _XEMBED_INFO.
+ */
 bool
-xembed_getinfo(systray_t *tray, xcb_window_t win, xembed_info_t *info)
+xembed_getinfo_reply(xcb_get_property_reply_t *prop, xembed_info_t *info)
 {
-	xcb_atom_t infoatom;
-	xcb_get_property_reply_t *prop;
 	uint32_t *xembed;
 
-	if (!(infoatom = xcb_atom_get(tray->xcb, "_XEMBED_INFO", false)))
-		return false;
-	if (!(prop = xcb_get_property_reply(tray->xcb, xcb_get_property(tray->xcb, 0, win, infoatom, XCB_GET_PROPERTY_TYPE_ANY, 0, 8), NULL)))
+	if (!prop || xcb_get_property_value_length(prop) < (int)sizeof(uint32_t) * 2)
 		return false;
 	xembed = (uint32_t *)xcb_get_property_value(prop);
 
 	info->version = xembed[0];
 	info->flags = xembed[1];
 
-	free(prop);
 	return true;
 }
 
@@ -243,6 +278,91 @@ systray_remove_item(systray_t *tray, xcb_window_t win)
 	}
 }
 
+/**
+ * systray_dock() - continuation of the dock request.
+ * @data: systray_request_t
+ * @reply: reply of _XEMBED_INFO.
+ * @timedout: true if the window did not answer in time.
+ *
+ * The reparent was requested before _XEMBED_INFO, so its result has
+ * already arrived and checking it does not block.
+ *
+ * Return: true if the window is docked.
+ */
+bool
+systray_dock(void *data, void *reply, bool timedout)
+{
+	systray_request_t *req = data;
+	systray_t *tray = req->tray;
+	xcb_generic_error_t *error;
+	systray_item_t *item;
+	bool docked = false;
+
+	if (timedout) {
+		xcb_discard_reply(tray->xcb, req->reparent.sequence);
+	} else if ((error = xcb_request_check(tray->xcb, req->reparent))) {
+		free(error);
+	} else {
+		/* notify to the window */
+		xembed_embedded_notify(tray, req->win, 0);
+		render_lock();
+		item = systray_append_item(tray, req->win);
+		xembed_getinfo_reply(reply, &item->info);
+		render_unlock();
+		docked = true;
+	}
+	free(reply);
+	free(req);
+	return docked;
+}
+
+/**
+ * systray_update_info() - continuation of the request of _XEMBED_INFO.
+ * @data: systray_request_t
+ * @reply: reply of _XEMBED_INFO.
+ * @timedout: true if the window did not answer in time.
+ *
+ * Return: true if the item has been mapped or unmapped.
+ */
+bool
+systray_update_info(void *data, void *reply, bool timedout)
+{
+	systray_request_t *req = data;
+	systray_t *tray = req->tray;
+	xcb_configure_window_value_list_t config = { 0 };
+	xembed_info_t info = { 0 };
+	systray_item_t *item;
+	bool changed = false;
+
+	xembed_getinfo_reply(reply, &info);
+	free(reply);
+
+	render_lock();
+	if (!timedout && (item = systray_find_item(tray, req->win)) && (item->info.flags ^ info.flags)) {
+		item->info.flags = info.flags;
+		if (item->info.flags & XEMBED_MAPPED) {
+			config.stack_mode = XCB_STACK_MODE_ABOVE;
+			xcb_configure_window_aux(tray->xcb, item->win, XCB_CONFIG_WINDOW_STACK_MODE, &config);
+		} else {
+			xcb_unmap_window(tray->xcb, item->win);
+		}
+		changed = true;
+	}
+	render_unlock();
+	free(req);
+	return changed;
+}
+
+/**
+ * systray_handle() - handle the X event for the tray.
+ * @tray: systray_t
+ * @ev: xcb_generic_event_t
+ *
+ * Replies of _XEMBED_INFO are taken by continuations, which modify items
+ * with render_lock() held.
+ *
+ * Return: 1 if the event is not for the tray, otherwise 0.
+ */
 int
 systray_handle(systray_t *tray, xcb_generic_event_t *ev)
 {
@@ -252,7 +372,7 @@ systray_handle(systray_t *tray, xcb_generic_event_t *ev)
 	xcb_property_notify_event_t *property;
 	xcb_change_window_attributes_value_list_t attrs = { 0 };
 	xcb_configure_window_value_list_t config = { 0 };
-	systray_item_t *item;
+	systray_request_t *req;
 
 	switch (ev->response_type & ~0x80) {
 	case XCB_SELECTION_CLEAR:
@@ -263,8 +383,7 @@ systray_handle(systray_t *tray, xcb_generic_event_t *ev)
 		break;
 	case XCB_CLIENT_MESSAGE:
 		client = (xcb_client_message_event_t *)ev;
-		atom = xcb_atom_get(tray->xcb, "_NET_SYSTEM_TRAY_OPCODE", true);
-		if (client->type != atom)
+		if (client->type != tray->opcode)
 			return 1;
 
 		xcb_window_t win = 0;
@@ -279,13 +398,13 @@ systray_handle(systray_t *tray, xcb_generic_event_t *ev)
 				config.height = tray->icon_size;
 				xcb_configure_window_aux(tray->xcb, win, XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT, &config);
 			}
-			if (xcb_request_check(tray->xcb, xcb_reparent_window(tray->xcb, win, tray->win, 0, 0)))
-				break;
 
-			/* notify to the window */
-			xembed_embedded_notify(tray, win, 0);
-			item = systray_append_item(tray, win);
-			xembed_getinfo(tray, win, &item->info);
+			/* both requests are answered in one round trip */
+			req = calloc(1, sizeof(systray_request_t));
+			req->tray = tray;
+			req->win = win;
+			req->reparent = xcb_reparent_window_checked(tray->xcb, win, tray->win, 0, 0);
+			async_xcb(xembed_getinfo(tray, win).sequence, ASYNC_TIMEOUT, systray_dock, req);
 
 			break;
 		}
@@ -293,21 +412,12 @@ systray_handle(systray_t *tray, xcb_generic_event_t *ev)
 	case XCB_PROPERTY_NOTIFY:
 		property = (xcb_property_notify_event_t *)ev;
 		if (property->state == XCB_PROPERTY_NEW_VALUE) {
-			if (!(item = systray_find_item(tray, property->window)))
+			if (!systray_find_item(tray, property->window))
 				return 1;
-			xembed_info_t info = { 0 };
-			xembed_getinfo(tray, property->window, &info);
-
-			if (!(item->info.flags ^ info.flags))
-				return 0;
-
-			item->info.flags = info.flags;
-			if (item->info.flags & XEMBED_MAPPED) {
-				config.stack_mode = XCB_STACK_MODE_ABOVE;
-				xcb_configure_window_aux(tray->xcb, property->window, XCB_CONFIG_WINDOW_STACK_MODE, &config);
-			} else {
-				xcb_unmap_window(tray->xcb, item->win);
-			}
+			req = calloc(1, sizeof(systray_request_t));
+			req->tray = tray;
+			req->win = property->window;
+			async_xcb(xembed_getinfo(tray, property->window).sequence, ASYNC_TIMEOUT, systray_update_info, req);
 		}
 		break;
 	}
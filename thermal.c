@@ -1,54 +1,61 @@
 /* See LICENSE file for copyright and license details. */
 
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 #include <unistd.h>
-#include <time.h>
 #if defined(__OpenBSD__) || defined(__FreeBSD__)
 # include <sys/types.h>
 # include <sys/sysctl.h>
 #endif
 
 #include "bspwmbar.h"
+#include "collect.h"
 #include "util.h"
 
-void
-thermal(draw_context_t *dc, module_option_t *opts)
-{
-#if defined(__linux)
-	static time_t prevtime;
-	static unsigned long temp;
-	static int thermal_found = -1;
+typedef struct {
+	bool found;
+	char value[16];
+} thermal_state_t;
 
-	if (thermal_found == -1) {
-		if (access(opts->thermal.sensor, F_OK) != -1)
-			thermal_found = 1;
-		else
-			thermal_found = 0;
-	}
-	if (!thermal_found)
-		return;
+/* functions */
+static bool thermal_update(module_option_t *, void *);
 
-	time_t curtime = time(NULL);
-	if (curtime - prevtime < 1)
-		goto DRAW_THERMAL;
-	prevtime = curtime;
+static const module_sampler_t sampler = {
+	.update = thermal_update,
+	.size = sizeof(thermal_state_t),
+	.interval = 1000,
+	.offload = true,
+};
 
-	if (pscanf(opts->thermal.sensor, "%ju", &temp) == -1)
-		return;
+/**
+ * thermal_update() - sample temperature of the sensor.
+ * @opts: module options.
+ * @state: thermal_state_t
+ *
+ * Return: true if the temperature has been changed.
+ */
+bool
+thermal_update(module_option_t *opts, void *state)
+{
+	thermal_state_t *thermal = state;
+	char value[sizeof(thermal->value)];
 
-DRAW_THERMAL:
-	if (!opts->thermal.prefix)
-		opts->thermal.prefix = "";
-	if (!opts->thermal.suffix)
-		opts->thermal.suffix = "";
+#if defined(__linux)
+	unsigned long temp;
+	char data[32];
 
-	sprintf(buf, "%s%lu%s", opts->thermal.prefix, temp / 1000,
-	        opts->thermal.suffix);
+	if (collect_read(collect_open(opts, opts->thermal.sensor), data, sizeof(data)) < 0)
+		return false;
+	if (sscanf(data, "%lu", &temp) != 1)
+		return false;
+	snprintf(value, sizeof(value), "%lu", temp / 1000);
 #elif defined(__OpenBSD__)
 	//int mib[3] = { HW_SENSORS, 0 };
-	sprintf(buf, "%sNOIMPL%s", opts->thermal.prefix, opts->thermal.suffix);
+	(void)opts;
+	snprintf(value, sizeof(value), "NOIMPL");
 #elif defined(__FreeBSD__)
 	int temp;
 	size_t templen = sizeof(temp);
@@ -56,13 +63,33 @@ DRAW_THERMAL:
 	char ctlname[64] = { 0 };
 	sprintf(ctlname, "hw.acpi.thermal.%s.temperature", opts->thermal.sensor);
 	if (sysctlbyname(ctlname, &temp, &templen, NULL, 0) < 0) {
-		return;
+		return false;
 	}
 
 	double atemp = (double)temp / 10 - 273.15;
-	sprintf(buf, "%s%.*f%s", opts->thermal.prefix, 1, atemp,
-	        opts->thermal.suffix);
+	snprintf(value, sizeof(value), "%.*f", 1, atemp);
 #endif
 
-	draw_text(dc, buf);
+	if (thermal->found && !strcmp(thermal->value, value))
+		return false;
+	thermal->found = true;
+	strcpy(thermal->value, value);
+	return true;
+}
+
+void
+thermal(draw_context_t *dc, module_option_t *opts)
+{
+	thermal_state_t *thermal = module_state(opts, &sampler);
+
+	if (!thermal->found)
+		return;
+	if (!opts->thermal.prefix)
+		opts->thermal.prefix = "";
+	if (!opts->thermal.suffix)
+		opts->thermal.suffix = "";
+
+	draw_text_run(dc, &opts->thermal.prefix_run, opts->thermal.prefix);
+	draw_numeric(dc, thermal->value);
+	draw_text_run(dc, &opts->thermal.suffix_run, opts->thermal.suffix);
 }
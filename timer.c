@@ -0,0 +1,231 @@
+/* See LICENSE file for copyright and license details. */
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "timer.h"
+#include "util.h"
+
+#define WHEEL_BITS  6
+#define WHEEL_SIZE  (1 << WHEEL_BITS)
+#define WHEEL_MASK  (WHEEL_SIZE - 1)
+#define WHEEL_DEPTH 4
+/* max distance of ticks that the wheel can hold */
+#define WHEEL_MAX   ((1ULL << (WHEEL_BITS * WHEEL_DEPTH)) - 1)
+
+/*
+ * Hierarchical timer wheel.
+ *
+ * The level n holds timers that expire within WHEEL_SIZE^(n+1) ticks, and
+ * each slot of the level n covers WHEEL_SIZE^n ticks. Slots of upper levels
+ * are cascaded to lower levels when the lower level wraps around.
+ */
+struct _timer_wheel_t {
+	uint64_t tick; /* next tick to be processed */
+	list_head slots[WHEEL_DEPTH][WHEEL_SIZE];
+};
+
+/* functions */
+static void timer_insert(timer_wheel_t *, timer_entry_t *);
+static void timer_cascade(timer_wheel_t *, int);
+
+/**
+ * timer_now() - get current time of the monotonic clock.
+ *
+ * Return: milliseconds
+ */
+uint64_t
+timer_now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * timer_wheel_new() - create a timer wheel starts at now.
+ *
+ * Return: timer_wheel_t *
+ */
+timer_wheel_t *
+timer_wheel_new()
+{
+	timer_wheel_t *wheel = calloc(1, sizeof(timer_wheel_t));
+	int i, j;
+
+	for (i = 0; i < WHEEL_DEPTH; i++)
+		for (j = 0; j < WHEEL_SIZE; j++)
+			list_head_init(&wheel->slots[i][j]);
+	wheel->tick = timer_now() / TIMER_TICK_MS;
+
+	return wheel;
+}
+
+/**
+ * timer_wheel_destroy() - free the timer wheel.
+ * @wheel: timer_wheel_t
+ *
+ * Timers in the wheel are detached but not freed.
+ */
+void
+timer_wheel_destroy(timer_wheel_t *wheel)
+{
+	list_head *pos, *tmp;
+	int i, j;
+
+	if (!wheel)
+		return;
+	for (i = 0; i < WHEEL_DEPTH; i++)
+		for (j = 0; j < WHEEL_SIZE; j++)
+			list_for_each_safe(&wheel->slots[i][j], pos, tmp)
+				timer_del(list_entry(pos, timer_entry_t, head));
+	free(wheel);
+}
+
+/**
+ * timer_insert() - insert the timer to the slot of its expiration.
+ * @wheel: timer_wheel_t
+ * @timer: timer_entry_t
+ */
+void
+timer_insert(timer_wheel_t *wheel, timer_entry_t *timer)
+{
+	uint64_t tick = DIVCEIL(timer->expire, TIMER_TICK_MS), delta;
+	int level;
+
+	if (tick < wheel->tick)
+		tick = wheel->tick;
+	delta = SMALLER(tick - wheel->tick, WHEEL_MAX);
+	tick = wheel->tick + delta;
+
+	for (level = 0; level < WHEEL_DEPTH - 1; level++)
+		if (delta < (1ULL << (WHEEL_BITS * (level + 1))))
+			break;
+
+	list_add_tail(&wheel->slots[level][(tick >> (WHEEL_BITS * level)) & WHEEL_MASK], &timer->head);
+}
+
+/**
+ * timer_add() - schedule the timer.
+ * @wheel: timer_wheel_t
+ * @timer: timer_entry_t
+ * @expire: expiration in milliseconds of timer_now().
+ *
+ * The timer is rescheduled if it is already scheduled.
+ */
+void
+timer_add(timer_wheel_t *wheel, timer_entry_t *timer, uint64_t expire)
+{
+	timer_del(timer);
+	timer->expire = expire;
+	timer_insert(wheel, timer);
+}
+
+/**
+ * timer_del() - cancel the timer.
+ * @timer: timer_entry_t
+ */
+void
+timer_del(timer_entry_t *timer)
+{
+	if (!timer->head.next || list_empty(&timer->head))
+		return;
+	list_del(&timer->head);
+	list_head_init(&timer->head);
+}
+
+/**
+ * timer_cascade() - move timers in the current slot of the level to lower.
+ * @wheel: timer_wheel_t
+ * @level: level of the wheel.
+ */
+void
+timer_cascade(timer_wheel_t *wheel, int level)
+{
+	list_head *slot = &wheel->slots[level][(wheel->tick >> (WHEEL_BITS * level)) & WHEEL_MASK];
+	list_head *pos, *tmp;
+
+	list_for_each_safe(slot, pos, tmp) {
+		list_del(pos);
+		timer_insert(wheel, list_entry(pos, timer_entry_t, head));
+	}
+}
+
+/**
+ * timer_wheel_run() - run expired timers.
+ * @wheel: timer_wheel_t
+ * @now: current time in milliseconds of timer_now().
+ *
+ * Expired timers are detached before their functions are called, so the
+ * functions can schedule them again.
+ *
+ * Return: number of expired timers.
+ */
+int
+timer_wheel_run(timer_wheel_t *wheel, uint64_t now)
+{
+	list_head expired, *pos, *tmp;
+	timer_entry_t *timer;
+	int level, n = 0;
+
+	list_head_init(&expired);
+	while (wheel->tick <= now / TIMER_TICK_MS) {
+		for (level = 1; level < WHEEL_DEPTH; level++) {
+			if (wheel->tick & ((1ULL << (WHEEL_BITS * level)) - 1))
+				break;
+			timer_cascade(wheel, level);
+		}
+		list_for_each_safe(&wheel->slots[0][wheel->tick & WHEEL_MASK], pos, tmp) {
+			list_del(pos);
+			list_add_tail(&expired, pos);
+		}
+		wheel->tick++;
+	}
+
+	while (!list_empty(&expired)) {
+		timer = list_entry(expired.next, timer_entry_t, head);
+		timer_del(timer);
+		timer->func(timer);
+		n++;
+	}
+	return n;
+}
+
+/**
+ * timer_wheel_next() - get the nearest expiration of timers.
+ * @wheel: timer_wheel_t
+ *
+ * Return: time in milliseconds of timer_now() when the next timer fires or
+ *         -1 if no timers.
+ */
+int64_t
+timer_wheel_next(timer_wheel_t *wheel)
+{
+	list_head *slot, *pos;
+	timer_entry_t *timer;
+	int64_t next = -1, expire;
+	int level, i;
+
+	for (level = 0; level < WHEEL_DEPTH; level++) {
+		/*
+		 * The first non-empty slot has the earliest timers of the level.
+		 * The current slot of upper levels has only timers of the next
+		 * round, so it is checked last.
+		 */
+		for (i = !!level; i < WHEEL_SIZE + !!level; i++) {
+			slot = &wheel->slots[level][((wheel->tick >> (WHEEL_BITS * level)) + i) & WHEEL_MASK];
+			if (list_empty(slot))
+				continue;
+			list_for_each(slot, pos) {
+				timer = list_entry(pos, timer_entry_t, head);
+				/* timers fire on the tick after their expiration */
+				expire = DIVCEIL(timer->expire, TIMER_TICK_MS) * TIMER_TICK_MS;
+				if (next < 0 || expire < next)
+					next = expire;
+			}
+			break;
+		}
+	}
+	return next;
+}
@@ -0,0 +1,33 @@
+/* See LICENSE file for copyright and license details. */
+
+#ifndef BSPWMBAR_TIMER_H_
+#define BSPWMBAR_TIMER_H_
+
+#include <stdint.h>
+
+#include "util.h"
+
+/* resolution of timers in milliseconds */
+#define TIMER_TICK_MS 10
+
+typedef struct _timer_entry_t timer_entry_t;
+typedef void (* timer_func_t)(timer_entry_t *);
+
+struct _timer_entry_t {
+	uint64_t expire; /* milliseconds of timer_now() */
+	timer_func_t func;
+
+	list_head head;
+};
+
+typedef struct _timer_wheel_t timer_wheel_t;
+
+uint64_t timer_now();
+timer_wheel_t *timer_wheel_new();
+void timer_wheel_destroy(timer_wheel_t *);
+void timer_add(timer_wheel_t *, timer_entry_t *, uint64_t);
+void timer_del(timer_entry_t *);
+int timer_wheel_run(timer_wheel_t *, uint64_t);
+int64_t timer_wheel_next(timer_wheel_t *);
+
+#endif /* BSPWMBAR_TIMER_H_ */
@@ -26,6 +26,17 @@ pscanf(const char *path, const char *fmt, ...)
 	return (n == EOF) ? -1 : n;
 }
 
+/* FNV-1a hash of the string */
+uint32_t
+strhash(const char *str)
+{
+	uint32_t hash = 2166136261u;
+
+	for (; *str; str++)
+		hash = (hash ^ (uint8_t)*str) * 16777619u;
+	return hash;
+}
+
 void
 list_init(list_head *head, list_head *prev, list_head *next)
 {
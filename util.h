@@ -4,6 +4,7 @@
 #define BSPWMBAR_UTIL_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <xcb/xcb.h>
 
 /* utility macros */
@@ -17,6 +18,7 @@
 #define err(...) { fprintf(stderr, __VA_ARGS__); }
 
 int pscanf(const char *, const char *, ...);
+uint32_t strhash(const char *);
 
 typedef struct _list_head {
 	struct _list_head *prev, *next;
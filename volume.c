@@ -1,5 +1,6 @@
 /* See LICENSE file for copyright and license details. */
 
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -18,18 +19,33 @@
  ((dinfo).type == AUDIO_MIXER_ENUM && \
   !strncmp((dinfo).label.name, AudioNmute, MAX_AUDIO_DEV_LEN)))
 
+#define VOLUME_STEP 12
+
+typedef struct {
+	int muted;
+	int level; /* percentage */
+} volume_state_t;
+
 /* functions */
+static bool volume_update(module_option_t *, void *);
 static int get_volume(int);
 static int is_muted(int);
 static void init_devinfo(int);
 static void toggle_mute(int);
 static void set_volume(int, int);
+static void volume_apply(module_option_t *, int);
 
 static char *file = NULL;
 static mixer_ctrl_t vctrl = { 0 };
 static mixer_ctrl_t mctrl = { 0 };
 static int initialized = 0;
 
+static const module_sampler_t sampler = {
+	.update = volume_update,
+	.size = sizeof(volume_state_t),
+	.interval = 1000,
+};
+
 int
 get_volume(int fd)
 {
@@ -100,32 +116,60 @@ init_devinfo(int fd)
 	initialized = 1;
 }
 
-void
-volume(draw_context_t *dc, module_option_t *opts)
+/**
+ * volume_update() - sample the master volume.
+ * @opts: module options.
+ * @state: volume_state_t
+ *
+ * Return: true if the volume or the mute state has been changed.
+ */
+bool
+volume_update(module_option_t *opts, void *state)
 {
+	volume_state_t *vol = state;
+	int fd, muted, level;
+	(void)opts;
+
 	if (!file) {
 		if ((file = getenv("MIXERDEVICE")) == 0 || *file == '\0')
 			file = "/dev/mixer";
 	}
 
-	int fd;
 	if ((fd = open(file, O_RDONLY)) < 0)
 		die("volume: failed to open %s\n", file);
 
 	if (!initialized)
 		init_devinfo(fd);
 
+	muted = is_muted(fd);
+	level = get_volume(fd) * 100 / 255;
+	close(fd);
+
+	if (muted == vol->muted && level == vol->level)
+		return false;
+	vol->muted = muted;
+	vol->level = level;
+	return true;
+}
+
+void
+volume(draw_context_t *dc, module_option_t *opts)
+{
+	volume_state_t *vol = module_state(opts, &sampler);
+	char level[16];
+
 	if (!opts->vol.prefix)
 		opts->vol.prefix = "";
 	if (!opts->vol.suffix)
 		opts->vol.suffix = "";
 
-	const char *mark = is_muted(fd) ? opts->vol.muted : opts->vol.unmuted;
-	sprintf(buf, "%s%s %d%s", opts->vol.prefix, mark, get_volume(fd) * 100 / 255,
-	                          opts->vol.suffix);
+	const char *mark = vol->muted ? opts->vol.muted : opts->vol.unmuted;
+	draw_text_run(dc, &opts->vol.prefix_run, opts->vol.prefix);
+	sprintf(buf, "%s ", mark);
 	draw_text(dc, buf);
-
-	close(fd);
+	sprintf(level, "%d", vol->level);
+	draw_numeric(dc, level);
+	draw_text_run(dc, &opts->vol.suffix_run, opts->vol.suffix);
 }
 
 void
@@ -152,33 +196,56 @@ set_volume(int fd, int vol)
 	ioctl(fd, AUDIO_MIXER_WRITE, &vctrl);
 }
 
+/**
+ * volume_apply() - set the volume moved by the scroll wheel.
+ * @opts: module options.
+ * @steps: net steps of the scroll wheel.
+ */
 void
-volume_ev(xcb_generic_event_t *ev, module_option_t *unused)
+volume_apply(module_option_t *opts, int steps)
 {
-	xcb_button_press_event_t *button;
 	int fd, vol;
-	(void)unused;
 
 	if ((fd = open(file, O_RDWR)) < 0)
 		die("volume: failed to open %s\n", file);
 
-	vol = get_volume(fd);
+	vol = get_volume(fd) + VOLUME_STEP * steps;
+	set_volume(fd, SMALLER(BIGGER(vol, 0), 255));
+	close(fd);
+	module_refresh(opts);
+}
+
+void
+volume_ev(xcb_generic_event_t *ev, module_option_t *opts)
+{
+	volume_state_t *state = module_state(opts, &sampler);
+	volume_state_t predicted = *state;
+	xcb_button_press_event_t *button;
+	int fd, steps;
 
 	switch (ev->response_type & ~0x80) {
 	case XCB_BUTTON_PRESS:
 		button = (xcb_button_press_event_t *)ev;
 		switch (button->detail) {
 		case XCB_BUTTON_INDEX_1:
+			if ((fd = open(file, O_RDWR)) < 0)
+				die("volume: failed to open %s\n", file);
 			toggle_mute(fd);
-			break;
+			close(fd);
+			module_refresh(opts);
+			return;
 		case XCB_BUTTON_INDEX_4:
-			set_volume(fd, SMALLER(vol + 12, 255));
+			steps = module_scroll(opts, 1, volume_apply);
 			break;
 		case XCB_BUTTON_INDEX_5:
-			set_volume(fd, BIGGER(vol - 12, 0));
+			steps = module_scroll(opts, -1, volume_apply);
 			break;
+		default:
+			return;
 		}
+		/* the mixer is written once the wheel stops */
+		predicted.level = SMALLER(BIGGER(state->level + steps * VOLUME_STEP * 100 / 255, 0), 100);
+		module_predict(opts, &predicted);
 		break;
 	}
-	close(fd);
 }
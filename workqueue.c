@@ -0,0 +1,285 @@
+/* See LICENSE file for copyright and license details. */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#if defined(__linux)
+# include <sys/eventfd.h>
+#endif
+
+#include "workqueue.h"
+#include "util.h"
+
+/*
+ * Pool of worker threads.
+ *
+ * Works are queued under the lock and run in order of submission. Finished
+ * works are pushed to a lock-free stack, and the owner thread is woken up
+ * through an eventfd (a pipe on BSD) to run their done functions.
+ */
+struct _workqueue_t {
+	pthread_t *threads;
+	int nthread;
+	int nbusy;
+	bool running;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	work_t *head, *tail; /* pending works */
+
+	_Atomic(work_t *) finished; /* stack of finished works */
+	int fd[2]; /* both ends are the same eventfd on Linux */
+};
+
+/* functions */
+static void *workqueue_run(void *);
+static void workqueue_notify(workqueue_t *);
+
+/**
+ * workqueue_new() - start worker threads.
+ * @nthread: number of threads.
+ *
+ * Return: workqueue_t * or NULL on failure.
+ */
+workqueue_t *
+workqueue_new(int nthread)
+{
+	workqueue_t *wq = calloc(1, sizeof(workqueue_t));
+	int i;
+
+#if defined(__linux)
+	if ((wq->fd[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+		free(wq);
+		return NULL;
+	}
+	wq->fd[1] = wq->fd[0];
+#else
+	if (pipe(wq->fd)) {
+		free(wq);
+		return NULL;
+	}
+	fcntl(wq->fd[0], F_SETFL, O_NONBLOCK);
+	fcntl(wq->fd[1], F_SETFL, O_NONBLOCK);
+#endif
+	pthread_mutex_init(&wq->lock, NULL);
+	pthread_cond_init(&wq->cond, NULL);
+	atomic_init(&wq->finished, NULL);
+	wq->running = true;
+
+	wq->threads = calloc(nthread, sizeof(pthread_t));
+	for (i = 0; i < nthread; i++) {
+		if (pthread_create(&wq->threads[i], NULL, workqueue_run, wq)) {
+			err("pthread_create(): failed to start worker\n");
+			break;
+		}
+		wq->nthread++;
+	}
+	if (!wq->nthread) {
+		workqueue_destroy(wq);
+		return NULL;
+	}
+	return wq;
+}
+
+/**
+ * workqueue_destroy() - stop worker threads.
+ * @wq: workqueue_t
+ *
+ * Works still pending are dropped. If a worker is blocked in a work, the
+ * queue is left to the running threads instead of waiting for it.
+ */
+void
+workqueue_destroy(workqueue_t *wq)
+{
+	int i, nbusy;
+
+	if (!wq)
+		return;
+
+	pthread_mutex_lock(&wq->lock);
+	wq->running = false;
+	wq->head = wq->tail = NULL;
+	nbusy = wq->nbusy;
+	pthread_cond_broadcast(&wq->cond);
+	pthread_mutex_unlock(&wq->lock);
+	if (nbusy)
+		return;
+
+	for (i = 0; i < wq->nthread; i++)
+		pthread_join(wq->threads[i], NULL);
+	close(wq->fd[0]);
+	if (wq->fd[1] != wq->fd[0])
+		close(wq->fd[1]);
+	pthread_cond_destroy(&wq->cond);
+	pthread_mutex_destroy(&wq->lock);
+	free(wq->threads);
+	free(wq);
+}
+
+/**
+ * workqueue_fd() - get the fd to poll for finished works.
+ * @wq: workqueue_t
+ *
+ * Return: fd
+ */
+int
+workqueue_fd(workqueue_t *wq)
+{
+	return wq->fd[0];
+}
+
+/**
+ * workqueue_push() - queue the work.
+ * @wq: workqueue_t
+ * @work: work_t
+ *
+ * Return: false if the queue has been stopped.
+ */
+bool
+workqueue_push(workqueue_t *wq, work_t *work)
+{
+	pthread_mutex_lock(&wq->lock);
+	if (!wq->running) {
+		pthread_mutex_unlock(&wq->lock);
+		return false;
+	}
+	work->next = NULL;
+	work->running = work->abandoned = false;
+	if (wq->tail)
+		wq->tail->next = work;
+	else
+		wq->head = work;
+	wq->tail = work;
+	pthread_cond_signal(&wq->cond);
+	pthread_mutex_unlock(&wq->lock);
+	return true;
+}
+
+/**
+ * workqueue_abandon() - replace the worker blocked in the work.
+ * @wq: workqueue_t
+ * @work: work_t
+ *
+ * A thread is started so the pool keeps its size while the work is blocked,
+ * and the blocked worker exits when the work returns. The done function of
+ * the work is still called.
+ *
+ * Return: false if the work is not running.
+ */
+bool
+workqueue_abandon(workqueue_t *wq, work_t *work)
+{
+	pthread_mutex_lock(&wq->lock);
+	if (!work->running) {
+		pthread_mutex_unlock(&wq->lock);
+		return false;
+	}
+	if (!work->abandoned) {
+		wq->threads = realloc(wq->threads, (wq->nthread + 1) * sizeof(pthread_t));
+		if (pthread_create(&wq->threads[wq->nthread], NULL, workqueue_run, wq)) {
+			err("pthread_create(): failed to replace worker\n");
+		} else {
+			wq->nthread++;
+			work->abandoned = true;
+		}
+	}
+	pthread_mutex_unlock(&wq->lock);
+	return true;
+}
+
+/**
+ * workqueue_notify() - wake up the owner thread.
+ * @wq: workqueue_t
+ */
+void
+workqueue_notify(workqueue_t *wq)
+{
+	uint64_t one = 1;
+
+	(void)!write(wq->fd[1], &one, (wq->fd[1] == wq->fd[0]) ? sizeof(one) : 1);
+}
+
+/**
+ * workqueue_run() - main loop of a worker thread.
+ * @arg: workqueue_t *
+ *
+ * Return: NULL
+ */
+void *
+workqueue_run(void *arg)
+{
+	workqueue_t *wq = arg;
+	work_t *work;
+	bool abandoned;
+
+	pthread_mutex_lock(&wq->lock);
+	while (wq->running) {
+		if (!(work = wq->head)) {
+			pthread_cond_wait(&wq->cond, &wq->lock);
+			continue;
+		}
+		if (!(wq->head = work->next))
+			wq->tail = NULL;
+		wq->nbusy++;
+		work->running = true;
+		pthread_mutex_unlock(&wq->lock);
+
+		work->func(work);
+
+		pthread_mutex_lock(&wq->lock);
+		work->running = false;
+		abandoned = work->abandoned;
+		pthread_mutex_unlock(&wq->lock);
+
+		/* push to the finished stack */
+		work->next = atomic_load_explicit(&wq->finished, memory_order_relaxed);
+		while (!atomic_compare_exchange_weak_explicit(&wq->finished, &work->next, work,
+		                                              memory_order_release, memory_order_relaxed))
+			;
+		workqueue_notify(wq);
+
+		pthread_mutex_lock(&wq->lock);
+		wq->nbusy--;
+		/* a replacement has been started */
+		if (abandoned)
+			break;
+	}
+	pthread_mutex_unlock(&wq->lock);
+
+	return NULL;
+}
+
+/**
+ * workqueue_complete() - run done functions of finished works.
+ * @wq: workqueue_t
+ *
+ * Return: number of finished works.
+ */
+int
+workqueue_complete(workqueue_t *wq)
+{
+	work_t *work, *next, *list = NULL;
+	uint64_t cnt;
+	int n = 0;
+
+	while (read(wq->fd[0], &cnt, sizeof(cnt)) > 0)
+		;
+
+	/* reverse the stack to run done functions in order of finish */
+	work = atomic_exchange_explicit(&wq->finished, NULL, memory_order_acquire);
+	for (; work; work = next) {
+		next = work->next;
+		work->next = list;
+		list = work;
+	}
+	for (work = list; work; work = next) {
+		next = work->next;
+		work->done(work);
+		n++;
+	}
+	return n;
+}
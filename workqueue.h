@@ -0,0 +1,30 @@
+/* See LICENSE file for copyright and license details. */
+
+#ifndef BSPWMBAR_WORKQUEUE_H_
+#define BSPWMBAR_WORKQUEUE_H_
+
+#include <stdbool.h>
+
+typedef struct _work_t work_t;
+typedef void (* work_func_t)(work_t *);
+
+struct _work_t {
+	work_func_t func; /* called on a worker thread */
+	work_func_t done; /* called by workqueue_complete() */
+
+	work_t *next;
+	/* under the lock of the queue */
+	bool running;
+	bool abandoned; /* the worker is replaced, and exits when the work returns */
+};
+
+typedef struct _workqueue_t workqueue_t;
+
+workqueue_t *workqueue_new(int);
+void workqueue_destroy(workqueue_t *);
+int workqueue_fd(workqueue_t *);
+bool workqueue_push(workqueue_t *, work_t *);
+bool workqueue_abandon(workqueue_t *, work_t *);
+int workqueue_complete(workqueue_t *);
+
+#endif /* BSPWMBAR_WORKQUEUE_H_ */
@@ -20,82 +20,213 @@ typedef struct {
 	int32_t cur;
 } xbacklight_t;
 
+typedef struct {
+	bool loaded;
+	uint32_t blightness; /* percentage */
+
+	/* used by the event handler without round trips */
+	xbacklight_t backlight;
+	xcb_randr_output_t output;
+} backlight_state_t;
+
 static bool init_atom(xcb_connection_t *);
-static bool xbacklight_load(xbacklight_t *, xcb_connection_t *);
-static bool xbacklight_load_info(xcb_connection_t *, xcb_randr_output_t, xbacklight_t *);
+static bool xbacklight_load(xbacklight_t *, xcb_randr_output_t *, xcb_connection_t *);
+static bool xbacklight_update(module_option_t *, void *);
+static bool xbacklight_load_info(xcb_connection_t *, xcb_randr_get_output_property_cookie_t, xcb_randr_query_output_property_cookie_t, xbacklight_t *);
 static void xbacklight_set(xcb_connection_t *, xcb_randr_output_t, int32_t);
+static uint32_t xbacklight_percent(const xbacklight_t *);
+static int32_t xbacklight_step(const xbacklight_t *, int);
+static void xbacklight_apply(module_option_t *, int);
 
 static xcb_atom_t atom_backlight;
-static xcb_randr_output_t output_cache;
+
+/* round trips to the X server are made on the worker pool */
+static const module_sampler_t sampler = {
+	.update = xbacklight_update,
+	.size = sizeof(backlight_state_t),
+	.interval = 1000,
+	.offload = true,
+};
+
+/**
+ * xbacklight_update() - sample brightness of the backlight.
+ * @opts: module options.
+ * @state: backlight_state_t
+ *
+ * Return: true if the brightness has been changed.
+ */
+bool
+xbacklight_update(module_option_t *opts, void *state)
+{
+	backlight_state_t *blight = state;
+	xbacklight_t backlight = { 0 };
+	xcb_randr_output_t output = 0;
+	uint32_t blightness;
+	bool loaded;
+	(void)opts;
+
+	if ((loaded = xbacklight_load(&backlight, &output, xcb_connection())))
+		blightness = xbacklight_percent(&backlight);
+	else
+		blightness = 0;
+	if (loaded == blight->loaded && blightness == blight->blightness &&
+	    output == blight->output && !memcmp(&backlight, &blight->backlight, sizeof(xbacklight_t)))
+		return false;
+	blight->loaded = loaded;
+	blight->blightness = blightness;
+	blight->backlight = backlight;
+	blight->output = output;
+	return true;
+}
+
+/**
+ * xbacklight_percent() - get brightness in percentage.
+ * @backlight: xbacklight_t
+ *
+ * Return: percentage
+ */
+uint32_t
+xbacklight_percent(const xbacklight_t *backlight)
+{
+	return (double)(backlight->cur - backlight->min) * 100 / (double)(backlight->max - backlight->min);
+}
+
+/**
+ * xbacklight_step() - get brightness moved by steps of 5%.
+ * @backlight: xbacklight_t
+ * @steps: steps of the scroll wheel.
+ *
+ * Return: brightness
+ */
+int32_t
+xbacklight_step(const xbacklight_t *backlight, int steps)
+{
+	double step = (double)(backlight->max - backlight->min) * 0.05 + 1;
+	double cur = backlight->cur + step * steps;
+
+	return SMALLER(BIGGER(cur, backlight->min), backlight->max);
+}
+
+/**
+ * xbacklight_apply() - set the brightness moved by the scroll wheel.
+ * @opts: module options.
+ * @steps: net steps of the scroll wheel.
+ */
+void
+xbacklight_apply(module_option_t *opts, int steps)
+{
+	backlight_state_t *state = module_state(opts, &sampler);
+
+	if (state->loaded)
+		xbacklight_set(xcb_connection(), state->output, xbacklight_step(&state->backlight, steps));
+	module_refresh(opts);
+}
 
 void
 xbacklight(draw_context_t *dc, module_option_t *opts)
 {
-	xbacklight_t backlight = { 0 };
-	uint32_t blightness = 0;
+	backlight_state_t *state = module_state(opts, &sampler);
+	char blightness[16];
 
-	if (!xbacklight_load(&backlight, xcb_connection()))
+	if (!state->loaded)
 		return;
 
-	blightness = (double)(backlight.cur - backlight.min) * 100 / (double)(backlight.max - backlight.min);
+	if (!opts->backlight.prefix)
+		opts->backlight.prefix = "";
+	if (!opts->backlight.suffix)
+		opts->backlight.suffix = "";
 
-	sprintf(buf, "%s%d%s", opts->backlight.prefix, blightness, opts->backlight.suffix);
-	draw_text(dc, buf);
+	draw_text_run(dc, &opts->backlight.prefix_run, opts->backlight.prefix);
+	sprintf(blightness, "%d", state->blightness);
+	draw_numeric(dc, blightness);
+	draw_text_run(dc, &opts->backlight.suffix_run, opts->backlight.suffix);
 }
 
+/**
+ * xbacklight_load() - load the backlight of the first output having it.
+ * @backlight: (out) xbacklight_t
+ * @output: (out) the output of the backlight.
+ * @xcb: xcb connection.
+ *
+ * Requests for all outputs are sent before waiting any reply, so the load
+ * takes two round trips regardless of the number of outputs.
+ *
+ * Return: false if no output has the backlight.
+ */
 bool
-xbacklight_load(xbacklight_t *backlight, xcb_connection_t *xcb)
+xbacklight_load(xbacklight_t *backlight, xcb_randr_output_t *output, xcb_connection_t *xcb)
 {
-	size_t i;
-	xcb_randr_get_screen_resources_reply_t *screen_reply;
+	xcb_randr_get_screen_resources_current_reply_t *screen_reply;
+	xcb_randr_get_output_property_cookie_t *props;
+	xcb_randr_query_output_property_cookie_t *queries;
 	xcb_randr_output_t *outputs;
+	bool found = false;
+	int i, n;
 
 	xcb_screen_t *scr = xcb_setup_roots_iterator(xcb_get_setup(xcb)).data;
 
-	screen_reply = xcb_randr_get_screen_resources_reply(xcb, xcb_randr_get_screen_resources(xcb, scr->root), NULL);
-	outputs = xcb_randr_get_screen_resources_outputs(screen_reply);
+	/* get atom for backlight */
+	if (!atom_backlight && !init_atom(xcb))
+		return false;
 
-	for (i = 0; i < screen_reply->num_outputs; i++) {
-		if (xbacklight_load_info(xcb, outputs[i], backlight)) {
-			output_cache = outputs[i];
-			break;
+	/* the current resources do not make the server probe outputs */
+	screen_reply = xcb_randr_get_screen_resources_current_reply(xcb, xcb_randr_get_screen_resources_current(xcb, scr->root), NULL);
+	if (!screen_reply)
+		return false;
+	outputs = xcb_randr_get_screen_resources_current_outputs(screen_reply);
+	n = screen_reply->num_outputs;
+
+	props = alloca(sizeof(xcb_randr_get_output_property_cookie_t) * n);
+	queries = alloca(sizeof(xcb_randr_query_output_property_cookie_t) * n);
+	for (i = 0; i < n; i++) {
+		props[i] = xcb_randr_get_output_property(xcb, outputs[i], atom_backlight, XCB_ATOM_NONE, 0, 4, 0, 0);
+		queries[i] = xcb_randr_query_output_property(xcb, outputs[i], atom_backlight);
+	}
+	for (i = 0; i < n; i++) {
+		if (found) {
+			xcb_discard_reply(xcb, props[i].sequence);
+			xcb_discard_reply(xcb, queries[i].sequence);
+		} else if (xbacklight_load_info(xcb, props[i], queries[i], backlight)) {
+			*output = outputs[i];
+			found = true;
 		}
 	}
 	free(screen_reply);
 
-	return true;
+	return found;
 }
 
+/**
+ * xbacklight_load_info() - take replies for the backlight of an output.
+ * @xcb: xcb connection.
+ * @prop: cookie of the backlight property.
+ * @query: cookie of the range of the backlight property.
+ * @backlight: (out) xbacklight_t
+ *
+ * Return: false if the output has no backlight.
+ */
 bool
-xbacklight_load_info(xcb_connection_t *xcb, xcb_randr_output_t output, xbacklight_t *backlight)
+xbacklight_load_info(xcb_connection_t *xcb, xcb_randr_get_output_property_cookie_t prop, xcb_randr_query_output_property_cookie_t query, xbacklight_t *backlight)
 {
 	xcb_randr_get_output_property_reply_t *prop_reply;
 	xcb_randr_query_output_property_reply_t *query_reply;
-	int32_t cur, *values;
+	int32_t *values;
+	bool loaded = false;
 
-	/* get atom for backlight */
-	if (!atom_backlight && !init_atom(xcb))
-		return false;
-
-	prop_reply = xcb_randr_get_output_property_reply(xcb, xcb_randr_get_output_property(xcb, output, atom_backlight, XCB_ATOM_NONE, 0, 4, 0, 0), NULL);
-	if (!prop_reply)
-		return false;
-	cur = *((int32_t *)xcb_randr_get_output_property_data(prop_reply));
-	free(prop_reply);
-
-	query_reply = xcb_randr_query_output_property_reply(xcb, xcb_randr_query_output_property(xcb, output, atom_backlight), NULL);
-	if (!query_reply)
-		return false;
-	if (query_reply->range && xcb_randr_query_output_property_valid_values_length(query_reply) == 2) {
-		backlight->cur = cur;
+	prop_reply = xcb_randr_get_output_property_reply(xcb, prop, NULL);
+	query_reply = xcb_randr_query_output_property_reply(xcb, query, NULL);
+	if (prop_reply && query_reply && xcb_randr_get_output_property_data_length(prop_reply) == 4 &&
+	    query_reply->range && xcb_randr_query_output_property_valid_values_length(query_reply) == 2) {
 		values = xcb_randr_query_output_property_valid_values(query_reply);
-
+		backlight->cur = *((int32_t *)xcb_randr_get_output_property_data(prop_reply));
 		backlight->min = values[0];
 		backlight->max = values[1];
+		loaded = backlight->max > backlight->min;
 	}
+	free(prop_reply);
 	free(query_reply);
 
-	return true;
+	return loaded;
 }
 
 void
@@ -109,37 +240,35 @@ xbacklight_set(xcb_connection_t *xcb, xcb_randr_output_t output, int32_t value)
 }
 
 void
-xbacklight_ev(xcb_generic_event_t *ev, module_option_t *unused)
+xbacklight_ev(xcb_generic_event_t *ev, module_option_t *opts)
 {
-	xbacklight_t backlight;
+	backlight_state_t *state = module_state(opts, &sampler);
+	backlight_state_t predicted = *state;
+	xbacklight_t moved = state->backlight;
 	xcb_button_press_event_t *button;
-	double cur, step;
-	(void)unused;
+	int steps;
 
-	xcb_connection_t *xcb = xcb_connection();
-	if (!xbacklight_load(&backlight, xcb))
+	if (!state->loaded)
 		return;
 
-	cur = (backlight.cur - backlight.min);
-	step = (double)(backlight.max - backlight.min) * 0.05 + 1;
-
 	switch (ev->response_type & ~0x80) {
 	case XCB_BUTTON_PRESS:
 		button = (xcb_button_press_event_t *)ev;
 		switch (button->detail) {
 		case XCB_BUTTON_INDEX_4:
-			cur = (cur / step) * step + step;
-			if (cur > backlight.max)
-				cur = backlight.max;
-			xbacklight_set(xcb, output_cache, cur);
+			steps = module_scroll(opts, 1, xbacklight_apply);
 			break;
 		case XCB_BUTTON_INDEX_5:
-			cur = (cur / step) * step - step;
-			if (cur < backlight.min)
-				cur = backlight.min;
-			xbacklight_set(xcb, output_cache, cur);
+			steps = module_scroll(opts, -1, xbacklight_apply);
 			break;
+		default:
+			module_refresh(opts);
+			return;
 		}
+		/* the property is changed once the wheel stops */
+		moved.cur = xbacklight_step(&state->backlight, steps);
+		predicted.blightness = xbacklight_percent(&moved);
+		module_predict(opts, &predicted);
 		break;
 	}
 }